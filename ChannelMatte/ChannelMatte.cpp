@@ -2,6 +2,9 @@
 #include "AEFX_SuiteHelper.h"
 #include "Smart_Utils.h"
 
+#include "ParamSchema.hpp"
+#include "PreRenderPool.hpp"
+
 #include "Settings.h"
 
 static PF_Err 
@@ -224,6 +227,13 @@ PixelIteratorFunc32 (
     return err;
 }
 
+// Params read into ParamInfo on every PreRender
+static constexpr ParamSchema::Entry PARAM_SCHEMA[] = {
+    ParamSchema::popup(PARAM_SOURCE_CHANNEL, PARAM_FIELD(ParamInfo, sourceChannel)),
+    ParamSchema::popup(PARAM_MATTE_TYPE, PARAM_FIELD(ParamInfo, matteType)),
+    ParamSchema::checkbox(PARAM_INVERT, PARAM_FIELD(ParamInfo, invert)),
+};
+
 static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
                         PF_PreRenderExtra *extra) {
     PF_Err err = PF_Err_NONE;
@@ -232,64 +242,19 @@ static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
     PF_RenderRequest req = extra->input->output_request;
     PF_CheckoutResult in_result;
 
-    // Create paramInfo
-    AEFX_SuiteScoper<PF_HandleSuite1> handleSuite
-        = AEFX_SuiteScoper<PF_HandleSuite1>(in_data,
-                                            kPFHandleSuite,
-                                            kPFHandleSuiteVersion1,
-                                            out_data);
-
-    PF_Handle paramInfoH = handleSuite->host_new_handle(sizeof(ParamInfo));
-    
-    if (!paramInfoH) {
-        return PF_Err_OUT_OF_MEMORY;
-    }
-    
-    ParamInfo *paramInfo = reinterpret_cast<ParamInfo*>(handleSuite->host_lock_handle(paramInfoH));
+    // Take paramInfo from the pool, which AE gives back once rendered
+    ParamInfo *paramInfo = PreRenderPool<ParamInfo>::acquire();
     
     if (!paramInfo) {
         return PF_Err_OUT_OF_MEMORY;
     }
     
     // Set handler
-    extra->output->pre_render_data = paramInfoH;
-    
-    // Checkout Params
-    PF_ParamDef source_channel_param;
-    AEFX_CLR_STRUCT(source_channel_param);
-    ERR(PF_CHECKOUT_PARAM(in_data,
-                          PARAM_SOURCE_CHANNEL,
-                          in_data->current_time,
-                          in_data->time_step,
-                          in_data->time_scale,
-                          &source_channel_param));
-    
-    PF_ParamDef matte_type_param;
-    AEFX_CLR_STRUCT(matte_type_param);
-    ERR(PF_CHECKOUT_PARAM(in_data,
-                          PARAM_MATTE_TYPE,
-                          in_data->current_time,
-                          in_data->time_step,
-                          in_data->time_scale,
-                          &matte_type_param));
-
-    PF_ParamDef invert_param;
-    AEFX_CLR_STRUCT(invert_param);
-    ERR(PF_CHECKOUT_PARAM(in_data,
-                          PARAM_INVERT,
-                          in_data->current_time,
-                          in_data->time_step,
-                          in_data->time_scale,
-                          &invert_param));
+    extra->output->pre_render_data = paramInfo;
+    extra->output->delete_pre_render_data_func = PreRenderPool<ParamInfo>::release;
     
     // Assign latest param values
-    if (!err) {
-        paramInfo->sourceChannel = source_channel_param.u.pd.value;
-        paramInfo->matteType = matte_type_param.u.pd.value;
-        paramInfo->invert = invert_param.u.bd.value;
-    }
-    
-    handleSuite->host_unlock_handle(paramInfoH);
+    ERR(ParamSchema::checkout(in_data, out_data, PARAM_SCHEMA, paramInfo));
     
     // Checkout Input Image
     ERR(extra->cb->checkout_layer(in_data->effect_ref, PARAM_INPUT,
@@ -323,12 +288,7 @@ static PF_Err SmartRender(PF_InData           *in_data,
     AEGP_SuiteHandler suites(in_data->pica_basicP);
     
     // Retrieve paramInfo
-    AEFX_SuiteScoper<PF_HandleSuite1> handleSuite =
-        AEFX_SuiteScoper<PF_HandleSuite1>(in_data,
-                                          kPFHandleSuite,
-                                          kPFHandleSuiteVersion1,
-                                          out_data);
-    ParamInfo *paramInfo = reinterpret_cast<ParamInfo*>(handleSuite->host_lock_handle(reinterpret_cast<PF_Handle>(extra->input->pre_render_data)));
+    ParamInfo *paramInfo = reinterpret_cast<ParamInfo*>(extra->input->pre_render_data);
     
     // Checkout layer pixels
     ERR((extra->cb->checkout_layer_pixels(in_data->effect_ref, PARAM_INPUT,
@@ -9,6 +9,13 @@
 #include "../Debug.h"
 #include "Settings.h"
 
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static PF_Err About(PF_InData *in_data, PF_OutData *out_data,
                     PF_ParamDef *params[], PF_LayerDef *output) {
     AEGP_SuiteHandler suites(in_data->pica_basicP);
@@ -58,10 +65,10 @@ static PF_Err GlobalSetup(PF_InData *in_data, PF_OutData *out_data,
     globalData->globalContext.bind();
 
     // Setup GL objects
-    globalData->inputTexture = *new OGL::Texture();
+    new (&globalData->inputTextureCache) AEOGLInterop::TextureCache();
     globalData->outputFbo = *new OGL::Fbo();
-    globalData->fboA = *new OGL::Fbo();
-    globalData->fboB = *new OGL::Fbo();
+    globalData->spareFbo = new OGL::Fbo();
+    new (&globalData->distanceCache) DistanceCache();
     globalData->quad = *new OGL::QuadVao();
 
     std::string shaderDir = AEUtils::getResourcesPath(in_data) + "shaders/";
@@ -95,7 +102,7 @@ static PF_Err ParamsSetup(PF_InData *in_data, PF_OutData *out_data,
     AEFX_CLR_STRUCT(def);
     PF_ADD_FLOAT_SLIDER("Width",       // NAME
                         0,             // VALID_MIN,
-                        2000,          // VALID_MAX
+                        10000,         // VALID_MAX
                         0,             // SLIDER_MIN
                         2000,          // SLIDER_MAX
                         200,           // CURVE_TORELANCE
@@ -107,9 +114,9 @@ static PF_Err ParamsSetup(PF_InData *in_data, PF_OutData *out_data,
 
     AEFX_CLR_STRUCT(def);
     PF_ADD_POPUP("Source Channel",
-                 2,
+                 3,
                  1,
-                 "Luma|Alpha",
+                 "Luma|Alpha|Per Channel",
                  PARAM_SOURCE);
 
     AEFX_CLR_STRUCT(def);
@@ -119,6 +126,20 @@ static PF_Err ParamsSetup(PF_InData *in_data, PF_OutData *out_data,
                     0,
                     PARAM_INVERT);
 
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_POPUP("Precision",
+                 5,
+                 PRECISION_FLOAT_PACKED,
+                 "Float|Float (Packed)|Half|Half (Packed)|Integer (Exact)",
+                 PARAM_PRECISION);
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_POPUP("Output",
+                 2,
+                 OUTPUT_DISTANCE,
+                 "Distance|Nearest Vector",
+                 PARAM_OUTPUT);
+
     out_data->num_params = PARAM_NUM_PARAMS;
 
     return err;
@@ -134,13 +155,13 @@ static PF_Err GlobalSetdown(PF_InData *in_data, PF_OutData *out_data,
         suites.HandleSuite1()->host_lock_handle(in_data->global_data));
 
     // Explicitly call deconstructor
-    globalData->inputTexture.~Texture();
+    globalData->inputTextureCache.~TextureCache();
+    globalData->distanceCache.~DistanceCache();
     globalData->thresholdShader.~Shader();
     globalData->distanceShader.~Shader();
     globalData->outputShader.~Shader();
     globalData->outputFbo.~Fbo();
-    globalData->fboA.~Fbo();
-    globalData->fboB.~Fbo();
+    delete globalData->spareFbo;
     globalData->quad.~QuadVao();
     globalData->globalContext.~GlobalContext();
 
@@ -149,62 +170,646 @@ static PF_Err GlobalSetdown(PF_InData *in_data, PF_OutData *out_data,
     return err;
 }
 
+// Params read into ParamInfo on every PreRender
+static constexpr ParamSchema::Entry PARAM_SCHEMA[] = {
+    ParamSchema::popup(PARAM_MODE, PARAM_FIELD(ParamInfo, mode)),
+    ParamSchema::floatSlider(PARAM_WIDTH, PARAM_FIELD(ParamInfo, width)),
+    ParamSchema::popup(PARAM_SOURCE, PARAM_FIELD(ParamInfo, source)),
+    ParamSchema::checkbox(PARAM_INVERT, PARAM_FIELD(ParamInfo, invert)),
+    ParamSchema::popup(PARAM_PRECISION, PARAM_FIELD(ParamInfo, precision)),
+    ParamSchema::popup(PARAM_OUTPUT, PARAM_FIELD(ParamInfo, output)),
+};
+
 static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
                         PF_PreRenderExtra *extra) {
     PF_Err err = PF_Err_NONE;
-    AEGP_SuiteHandler suites(in_data->pica_basicP);
-    auto handleSuite = suites.HandleSuite1();
 
     PF_RenderRequest req = extra->input->output_request;
     PF_CheckoutResult in_result;
 
-    // Create paramInfo
-    PF_Handle paramInfoH = handleSuite->host_new_handle(sizeof(ParamInfo));
+    // Take paramInfo from the pool, which AE gives back once rendered
+    ParamInfo *paramInfo = PreRenderPool<ParamInfo>::acquire();
 
-    if (!paramInfoH) {
+    if (!paramInfo) {
         return PF_Err_OUT_OF_MEMORY;
     }
 
     // Set handler
-    extra->output->pre_render_data = paramInfoH;
-
-    ParamInfo *paramInfo = reinterpret_cast<ParamInfo *>(
-        handleSuite->host_lock_handle(paramInfoH));
-
-    if (!paramInfo) {
-        err = PF_Err_OUT_OF_MEMORY;
-    }
+    extra->output->pre_render_data = paramInfo;
+    extra->output->delete_pre_render_data_func = PreRenderPool<ParamInfo>::release;
 
     // Assign latest param values
-    ERR(AEOGLInterop::getPopupParam(in_data, out_data, PARAM_MODE,
-                                    &paramInfo->mode));
-
-    ERR(AEOGLInterop::getFloatSliderParam(in_data, out_data, PARAM_WIDTH,
-                                          &paramInfo->width));
+    ERR(ParamSchema::checkout(in_data, out_data, PARAM_SCHEMA, paramInfo));
 
-    ERR(AEOGLInterop::getPopupParam(in_data, out_data, PARAM_SOURCE,
-                                    &paramInfo->source));
+    // Distance reaches Width pixels beyond the layer content in both ways
+    A_long marginX = 0, marginY = 0;
 
-    ERR(AEOGLInterop::getCheckboxParam(in_data, out_data, PARAM_INVERT,
-                                       &paramInfo->invert));
+    if (!err) {
+        float downsampleX = (float)in_data->downsample_x.num / in_data->downsample_x.den;
+        float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
+        marginX = (A_long)std::ceil(paramInfo->width * downsampleX);
+        marginY = (A_long)std::ceil(paramInfo->width * downsampleY);
+    }
 
-    handleSuite->host_unlock_handle(paramInfoH);
+    // Checkout only the input within reach of the requested output
+    AEUtils::growRect(&req.rect, marginX, marginY);
 
-    // Checkout input image
     ERR(extra->cb->checkout_layer(in_data->effect_ref, PARAM_INPUT, PARAM_INPUT,
                                   &req, in_data->current_time,
                                   in_data->time_step, in_data->time_scale,
                                   &in_result));
 
-    // Compute the rect to render
+    // Compute the rect to render. The output extends the non-empty input
+    // bounds by Width, clipped to what has been requested.
     if (!err) {
-        UnionLRect(&in_result.result_rect, &extra->output->result_rect);
-        UnionLRect(&in_result.max_result_rect, &extra->output->max_result_rect);
+        PF_LRect resultRect = in_result.result_rect;
+        PF_LRect maxResultRect = in_result.max_result_rect;
+
+        if (!AEUtils::isEmptyRect(&resultRect)) {
+            AEUtils::growRect(&resultRect, marginX, marginY);
+            AEUtils::intersectRect(&extra->input->output_request.rect, &resultRect);
+        }
+        AEUtils::growRect(&maxResultRect, marginX, marginY);
+
+        UnionLRect(&resultRect, &extra->output->result_rect);
+        UnionLRect(&maxResultRect, &extra->output->max_result_rect);
+
+        paramInfo->inputRect = in_result.result_rect;
+        paramInfo->outputRect = extra->output->result_rect;
+        paramInfo->requestRect = extra->input->output_request.rect;
+    }
+
+    return err;
+}
+
+// Run 1D distance propagation passes along one axis, ping-ponging between
+// fboSrc and fboDst. The GL queue is flushed at a bounded interval so that
+// abort requests and progress are checked while the GPU is busy.
+static PF_Err RenderDistancePasses(PF_InData *in_data, GlobalData *globalData,
+                                   OGL::Fbo **fboSrc, OGL::Fbo **fboDst,
+                                   int firstPass, int lastPass,
+                                   float offsetX, float offsetY,
+                                   A_long progressBase, A_long progressTotal) {
+    PF_Err err = PF_Err_NONE;
+
+    for (int i = firstPass; i < lastPass && !err; i++) {
+        float beta = 2 * i + 1;
+
+        (*fboDst)->bind();
+        globalData->distanceShader.setTexture("tex0", (*fboSrc)->getTexture(), 0);
+        globalData->distanceShader.setFloat("beta", beta);
+        globalData->distanceShader.setVec2("offset", offsetX, offsetY);
+        globalData->quad.render();
+
+        OGL::Fbo *swap = *fboDst;
+        *fboDst = *fboSrc;
+        *fboSrc = swap;
+
+        if ((i + 1) % ABORT_CHECK_INTERVAL == 0) {
+            glFlush();
+            ERR(PF_ABORT(in_data));
+            ERR(PF_PROGRESS(in_data, progressBase + i + 1 - firstPass, progressTotal));
+        }
     }
 
     return err;
 }
 
+// Threshold a row of AE pixels into a 1-byte inside/outside mask. A pixel is
+// inside when its luma (mean of RGB) or alpha is above half, depending on
+// Source. The integer thresholds are the largest values not above half.
+#define MASK_THRESHOLD8 127
+#define MASK_THRESHOLD_LUMA8 382
+#define MASK_THRESHOLD16 16384
+#define MASK_THRESHOLD_LUMA16 49152
+
+static bool IsInside(const PF_Pixel8 &p, A_long source) {
+    return source == SOURCE_LUMA ? p.red + p.green + p.blue > MASK_THRESHOLD_LUMA8
+                                 : p.alpha > MASK_THRESHOLD8;
+}
+
+static bool IsInside(const PF_Pixel16 &p, A_long source) {
+    return source == SOURCE_LUMA ? p.red + p.green + p.blue > MASK_THRESHOLD_LUMA16
+                                 : p.alpha > MASK_THRESHOLD16;
+}
+
+static bool IsInside(const PF_PixelFloat &p, A_long source) {
+    return source == SOURCE_LUMA ? p.red + p.green + p.blue > 1.5f
+                                 : p.alpha > 0.5f;
+}
+
+static bool IsAboveHalf(A_u_char v) {
+    return v > MASK_THRESHOLD8;
+}
+
+static bool IsAboveHalf(A_u_short v) {
+    return v > MASK_THRESHOLD16;
+}
+
+static bool IsAboveHalf(PF_FpShort v) {
+    return v > 0.5f;
+}
+
+// Threshold R, G, B and A separately, writing each to its own mask pointer
+// advancing by step bytes per pixel
+template <typename PixelType>
+static void ThresholdChannelsRow(const PixelType *srcP, A_u_char *dstP[4],
+                                 A_long step, A_long width) {
+    for (A_long x = 0, i = 0; x < width; x++, i += step) {
+        dstP[0][i] = IsAboveHalf(srcP[x].red) ? 0xff : 0;
+        dstP[1][i] = IsAboveHalf(srcP[x].green) ? 0xff : 0;
+        dstP[2][i] = IsAboveHalf(srcP[x].blue) ? 0xff : 0;
+        dstP[3][i] = IsAboveHalf(srcP[x].alpha) ? 0xff : 0;
+    }
+}
+
+template <typename PixelType>
+static void ThresholdRow(const PixelType *srcP, A_u_char *dstP, A_long width,
+                         A_long source) {
+    for (A_long x = 0; x < width; x++) {
+        dstP[x] = IsInside(srcP[x], source) ? 0xff : 0;
+    }
+}
+
+#ifdef __SSE2__
+// 8bpc pixels are packed as 32-bit ARGB words, so 16 pixels are thresholded
+// at once by shifting each channel down to the low byte of its lane.
+template <>
+void ThresholdRow<PF_Pixel8>(const PF_Pixel8 *srcP, A_u_char *dstP,
+                             A_long width, A_long source) {
+    const __m128i lowByte = _mm_set1_epi32(0xff);
+    const __m128i threshold = _mm_set1_epi32(
+        source == SOURCE_LUMA ? MASK_THRESHOLD_LUMA8 : MASK_THRESHOLD8);
+
+    A_long x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i inside[4];
+
+        for (int i = 0; i < 4; i++) {
+            __m128i argb = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(srcP + x + i * 4));
+            __m128i value;
+
+            if (source == SOURCE_LUMA) {
+                __m128i r = _mm_and_si128(_mm_srli_epi32(argb, 8), lowByte);
+                __m128i g = _mm_and_si128(_mm_srli_epi32(argb, 16), lowByte);
+                __m128i b = _mm_srli_epi32(argb, 24);
+                value = _mm_add_epi32(_mm_add_epi32(r, g), b);
+            } else {
+                value = _mm_and_si128(argb, lowByte);
+            }
+
+            inside[i] = _mm_cmpgt_epi32(value, threshold);
+        }
+
+        // Narrow the all-ones/all-zeros lanes down to bytes
+        __m128i lo = _mm_packs_epi32(inside[0], inside[1]);
+        __m128i hi = _mm_packs_epi32(inside[2], inside[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dstP + x),
+                         _mm_packs_epi16(lo, hi));
+    }
+
+    for (; x < width; x++) {
+        dstP[x] = IsInside(srcP[x], source) ? 0xff : 0;
+    }
+}
+#endif
+
+struct MaskRefcon {
+    PF_InData *in_data;
+    PF_EffectWorld *worldP;
+    PF_PixelFormat format;
+    A_long source;
+    A_u_char *maskP;
+
+    // Placement of the input within the mask
+    A_long maskWidth;
+    A_long originX, originY;
+    bool flip;
+
+    // For Per Channel, the distance between the planes of each channel, or
+    // zero to interleave them as RGBA
+    size_t planeSize;
+};
+
+template <typename PixelType>
+static void ThresholdInputRow(const MaskRefcon *refcon, const PixelType *srcP,
+                              A_long y) {
+    PF_EffectWorld *worldP = refcon->worldP;
+
+    A_long row = refcon->flip ? worldP->height - y - 1 : y;
+    size_t offset = (size_t)(row + refcon->originY) * refcon->maskWidth +
+                    refcon->originX;
+
+    if (refcon->source != SOURCE_PER_CHANNEL) {
+        ThresholdRow(srcP, refcon->maskP + offset, worldP->width, refcon->source);
+        return;
+    }
+
+    A_u_char *dstP[4];
+    A_long step = refcon->planeSize > 0 ? 1 : 4;
+
+    for (int c = 0; c < 4; c++) {
+        dstP[c] = refcon->planeSize > 0
+                      ? refcon->maskP + c * refcon->planeSize + offset
+                      : refcon->maskP + offset * 4 + c;
+    }
+
+    ThresholdChannelsRow(srcP, dstP, step, worldP->width);
+}
+
+// Threshold a band of rows, flipped vertically for OpenGL if asked
+static PF_Err ThresholdBand(void *refconPV, A_long thread_indexL, A_long i,
+                            A_long iterationsL) {
+    MaskRefcon *refcon = reinterpret_cast<MaskRefcon *>(refconPV);
+    PF_EffectWorld *worldP = refcon->worldP;
+
+    A_long yStart = i * MASK_BAND_ROWS;
+    A_long yEnd = std::min(yStart + MASK_BAND_ROWS, worldP->height);
+
+    for (A_long y = yStart; y < yEnd; y++) {
+        const char *srcP = (const char *)worldP->data + y * worldP->rowbytes;
+
+        switch (refcon->format) {
+            case PF_PixelFormat_ARGB32:
+                ThresholdInputRow(refcon, reinterpret_cast<const PF_Pixel8 *>(srcP), y);
+                break;
+            case PF_PixelFormat_ARGB64:
+                ThresholdInputRow(refcon, reinterpret_cast<const PF_Pixel16 *>(srcP), y);
+                break;
+            case PF_PixelFormat_ARGB128:
+                ThresholdInputRow(refcon, reinterpret_cast<const PF_PixelFloat *>(srcP), y);
+                break;
+        }
+    }
+
+    return PF_ABORT(refcon->in_data);
+}
+
+// Get the 1-byte-per-pixel mask of the input for the Source, thresholding
+// and uploading it only when no resident texture matches. The mask is a
+// fraction of the size of the full ARGB layer, so is the upload. Per Channel
+// masks have a byte for each of R, G, B and A.
+static PF_Err GetMaskTexture(PF_InData *in_data, GlobalData *globalData,
+                             const AEOGLInterop::TextureCache::Key &inputKey,
+                             PF_EffectWorld *input_worldP, PF_PixelFormat format,
+                             A_long source, void *maskBufferP,
+                             OGL::Texture **maskTexture) {
+    PF_Err err = PF_Err_NONE;
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+
+    AEOGLInterop::TextureCache::Key key = inputKey;
+    key.format = source == SOURCE_PER_CHANNEL ? GL_RGBA : GL_RED;
+    key.pixelType = GL_UNSIGNED_BYTE;
+    key.variant = source;
+
+    *maskTexture = globalData->inputTextureCache.find(key);
+
+    if (*maskTexture) {
+        return err;
+    }
+
+    MaskRefcon refcon;
+    refcon.in_data = in_data;
+    refcon.worldP = input_worldP;
+    refcon.format = format;
+    refcon.source = source;
+    refcon.maskP = reinterpret_cast<A_u_char *>(maskBufferP);
+    refcon.maskWidth = input_worldP->width;
+    refcon.originX = 0;
+    refcon.originY = 0;
+    refcon.flip = true;
+    refcon.planeSize = 0;
+
+    A_long bands = (input_worldP->height + MASK_BAND_ROWS - 1) / MASK_BAND_ROWS;
+    ERR(suites.Iterate8Suite1()->iterate_generic(bands, &refcon, ThresholdBand));
+
+    if (!err) {
+        GLsizei width = input_worldP->width;
+        GLsizei height = input_worldP->height;
+
+        size_t channels = key.format == GL_RGBA ? 4 : 1;
+        *maskTexture = globalData->inputTextureCache.insert(
+            key, width * height * channels);
+
+        (*maskTexture)->bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, key.format,
+                        GL_UNSIGNED_BYTE, maskBufferP);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        (*maskTexture)->unbind();
+    }
+
+    return err;
+}
+
+struct ExactRefcon {
+    PF_InData *in_data;
+    const uint8_t *maskP;
+    uint32_t *fieldP;
+    uint32_t *nearestP;  // Optional
+    A_long width, height;
+
+    // Bands per plane. The planes of Per Channel are run as bands in a row.
+    A_long bands;
+};
+
+static PF_Err ExactColumnBand(void *refconPV, A_long thread_indexL, A_long i,
+                              A_long iterationsL) {
+    ExactRefcon *refcon = reinterpret_cast<ExactRefcon *>(refconPV);
+
+    size_t planeOffset = (size_t)(i / refcon->bands) * refcon->width * refcon->height;
+    A_long xStart = (i % refcon->bands) * EXACT_BAND_COLUMNS;
+    A_long xEnd = std::min(xStart + EXACT_BAND_COLUMNS, refcon->width);
+
+    DistanceTransform::columnPass(refcon->maskP + planeOffset,
+                                  refcon->fieldP + planeOffset,
+                                  refcon->nearestP, refcon->width,
+                                  refcon->height, xStart, xEnd);
+
+    return PF_ABORT(refcon->in_data);
+}
+
+static PF_Err ExactRowBand(void *refconPV, A_long thread_indexL, A_long i,
+                           A_long iterationsL) {
+    ExactRefcon *refcon = reinterpret_cast<ExactRefcon *>(refconPV);
+
+    size_t planeOffset = (size_t)(i / refcon->bands) * refcon->width * refcon->height;
+    A_long yStart = (i % refcon->bands) * MASK_BAND_ROWS;
+    A_long yEnd = std::min(yStart + MASK_BAND_ROWS, refcon->height);
+
+    DistanceTransform::rowPass(refcon->maskP + planeOffset,
+                               refcon->fieldP + planeOffset, refcon->nearestP,
+                               refcon->width, yStart, yEnd);
+
+    return PF_ABORT(refcon->in_data);
+}
+
+// Whether the distance of the pixel shows in the Mode
+static bool IsInMode(bool inside, A_long mode) {
+    return mode == MODE_INSIDE ? inside : mode == MODE_OUTSIDE ? !inside : true;
+}
+
+// Map a squared distance to the output luma in the same way as output.frag
+static float GetLuma(bool inside, uint32_t distSquared, float width,
+                     A_long mode, PF_Boolean invert) {
+    float dist = std::sqrt((float)distSquared);
+    float normDist = width > 0 ? std::min(dist / width, 1.0f)
+                               : (distSquared > 0 ? 1.0f : 0.0f);
+
+    float outside = inside ? 0.0f : normDist;
+    float insideDist = inside ? normDist : 0.0f;
+    float luma = 0.0f;
+
+    switch (mode) {
+        case MODE_INSIDE:
+            luma = insideDist;
+            break;
+        case MODE_OUTSIDE:
+            luma = outside;
+            break;
+        case MODE_BOTH_SIGNED:
+            luma = 0.5f + (outside - insideDist) / 2.0f;
+            break;
+        default:
+            luma = outside + insideDist;
+            break;
+    }
+
+    return invert ? 1.0f - luma : luma;
+}
+
+// Write a color, clamped to the range of integer depths
+static void SetColor(PF_Pixel8 *p, float r, float g, float b, float a = 1.0f) {
+    p->alpha = (A_u_char)(std::min(std::max(a, 0.0f), 1.0f) * PF_MAX_CHAN8 + 0.5f);
+    p->red = (A_u_char)(std::min(std::max(r, 0.0f), 1.0f) * PF_MAX_CHAN8 + 0.5f);
+    p->green = (A_u_char)(std::min(std::max(g, 0.0f), 1.0f) * PF_MAX_CHAN8 + 0.5f);
+    p->blue = (A_u_char)(std::min(std::max(b, 0.0f), 1.0f) * PF_MAX_CHAN8 + 0.5f);
+}
+
+static void SetColor(PF_Pixel16 *p, float r, float g, float b, float a = 1.0f) {
+    p->alpha = (A_u_short)(std::min(std::max(a, 0.0f), 1.0f) * PF_MAX_CHAN16 + 0.5f);
+    p->red = (A_u_short)(std::min(std::max(r, 0.0f), 1.0f) * PF_MAX_CHAN16 + 0.5f);
+    p->green = (A_u_short)(std::min(std::max(g, 0.0f), 1.0f) * PF_MAX_CHAN16 + 0.5f);
+    p->blue = (A_u_short)(std::min(std::max(b, 0.0f), 1.0f) * PF_MAX_CHAN16 + 0.5f);
+}
+
+static void SetColor(PF_PixelFloat *p, float r, float g, float b, float a = 1.0f) {
+    p->alpha = a;
+    p->red = r;
+    p->green = g;
+    p->blue = b;
+}
+
+struct ExactOutputRefcon {
+    PF_InData *in_data;
+    const DistanceCache::Field *cached;
+    A_long fieldWidth;
+    A_long originX, originY;  // Offset of the output within the field
+    PF_EffectWorld *worldP;
+    PF_PixelFormat format;
+    float width;
+    A_long mode;
+    PF_Boolean invert;
+    bool nearestVector;
+    bool perChannel;
+};
+
+template <typename PixelType>
+static void WriteExactRow(const ExactOutputRefcon *refcon, A_long y) {
+    PF_EffectWorld *worldP = refcon->worldP;
+    PixelType *dstP = reinterpret_cast<PixelType *>(
+        (char *)worldP->data + y * worldP->rowbytes);
+
+    size_t offset = (size_t)(y + refcon->originY) * refcon->fieldWidth +
+                    refcon->originX;
+    const uint8_t *maskP = refcon->cached->exactMask.data() + offset;
+    const uint32_t *fieldP = refcon->cached->exactField.data() + offset;
+
+    if (refcon->perChannel) {
+        // The field of each channel goes to the same channel
+        size_t planeSize = refcon->cached->exactField.size() / 4;
+        float luma[4];
+
+        for (A_long x = 0; x < worldP->width; x++) {
+            for (int c = 0; c < 4; c++) {
+                size_t j = c * planeSize + x;
+                luma[c] = GetLuma(maskP[j] != 0, fieldP[j], refcon->width,
+                                  refcon->mode, refcon->invert);
+            }
+            SetColor(&dstP[x], luma[0], luma[1], luma[2], luma[3]);
+        }
+        return;
+    }
+
+    if (!refcon->nearestVector) {
+        for (A_long x = 0; x < worldP->width; x++) {
+            float luma = GetLuma(maskP[x] != 0, fieldP[x], refcon->width,
+                                 refcon->mode, refcon->invert);
+            SetColor(&dstP[x], luma, luma, luma);
+        }
+        return;
+    }
+
+    // Vector to the nearest pixel of the other class in R and G, mapping
+    // -Width..Width to 0..1, and the distance in B
+    const uint32_t *nearestP = refcon->cached->exactNearest.data() + offset;
+    float scale = refcon->width > 0 ? 0.5f / refcon->width : 0.0f;
+    A_long fieldX = refcon->originX, fieldY = y + refcon->originY;
+
+    for (A_long x = 0; x < worldP->width; x++) {
+        bool inside = maskP[x] != 0;
+        float luma = GetLuma(inside, fieldP[x], refcon->width, refcon->mode,
+                             refcon->invert);
+
+        float dx = 0, dy = 0;
+        if (nearestP[x] != NEAREST_NONE && IsInMode(inside, refcon->mode)) {
+            dx = (float)((A_long)(nearestP[x] % refcon->fieldWidth) - (fieldX + x));
+            dy = (float)((A_long)(nearestP[x] / refcon->fieldWidth) - fieldY);
+        }
+
+        SetColor(&dstP[x], 0.5f + dx * scale, 0.5f + dy * scale, luma);
+    }
+}
+
+static PF_Err WriteExactBand(void *refconPV, A_long thread_indexL, A_long i,
+                             A_long iterationsL) {
+    ExactOutputRefcon *refcon = reinterpret_cast<ExactOutputRefcon *>(refconPV);
+
+    A_long yStart = i * MASK_BAND_ROWS;
+    A_long yEnd = std::min(yStart + MASK_BAND_ROWS, refcon->worldP->height);
+
+    for (A_long y = yStart; y < yEnd; y++) {
+        switch (refcon->format) {
+            case PF_PixelFormat_ARGB32:
+                WriteExactRow<PF_Pixel8>(refcon, y);
+                break;
+            case PF_PixelFormat_ARGB64:
+                WriteExactRow<PF_Pixel16>(refcon, y);
+                break;
+            case PF_PixelFormat_ARGB128:
+                WriteExactRow<PF_PixelFloat>(refcon, y);
+                break;
+        }
+    }
+
+    return PF_ABORT(refcon->in_data);
+}
+
+// Compute the field with exact integer squared distances on the CPU, and
+// write the output from it. The passes are linear in the number of pixels
+// whatever Width is, so this path has no upper limit to the reach.
+static PF_Err RenderExact(PF_InData *in_data, GlobalData *globalData,
+                          ParamInfo *paramInfo, PF_EffectWorld *input_worldP,
+                          PF_EffectWorld *output_worldP, PF_PixelFormat format,
+                          const DistanceCache::Key &cacheKey,
+                          A_long outputOriginX, A_long outputOriginY,
+                          float distanceWidth) {
+    PF_Err err = PF_Err_NONE;
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+    auto iterateSuite = suites.Iterate8Suite1();
+
+    A_long fieldWidth = cacheKey.fieldWidth;
+    A_long fieldHeight = cacheKey.fieldHeight;
+
+    // The four fields of Per Channel are laid out as planes one after another.
+    // They have no single nearest pixel, so only the distances are output.
+    bool perChannel = paramInfo->source == SOURCE_PER_CHANNEL;
+    A_long planes = perChannel ? 4 : 1;
+    size_t planeSize = (size_t)fieldWidth * fieldHeight;
+
+    bool nearestVector = cacheKey.nearest;
+
+    size_t fieldBytes = planes * planeSize * (sizeof(uint8_t) + sizeof(uint32_t)) +
+                        (nearestVector ? planeSize * sizeof(uint32_t) : 0);
+    DistanceCache::Field *cached = globalData->distanceCache.getField(cacheKey,
+                                                                      fieldBytes);
+
+    if (!cached->valid) {
+        FX_LOG_TIME_START(exactTime);
+
+        cached->exactMask.assign(planes * planeSize, 0);
+        cached->exactField.resize(planes * planeSize);
+
+        if (nearestVector) {
+            cached->exactNearest.resize(planeSize);
+        }
+
+        // Threshold the input into its place within the field
+        MaskRefcon maskRefcon;
+        maskRefcon.in_data = in_data;
+        maskRefcon.worldP = input_worldP;
+        maskRefcon.format = format;
+        maskRefcon.source = paramInfo->source;
+        maskRefcon.maskP = cached->exactMask.data();
+        maskRefcon.maskWidth = fieldWidth;
+        maskRefcon.originX = cacheKey.originX;
+        maskRefcon.originY = cacheKey.originY;
+        maskRefcon.flip = false;
+        maskRefcon.planeSize = planeSize;
+
+        A_long inputBands = (input_worldP->height + MASK_BAND_ROWS - 1) / MASK_BAND_ROWS;
+        ERR(iterateSuite->iterate_generic(inputBands, &maskRefcon, ThresholdBand));
+
+        ExactRefcon refcon;
+        refcon.in_data = in_data;
+        refcon.maskP = cached->exactMask.data();
+        refcon.fieldP = cached->exactField.data();
+        refcon.nearestP = nearestVector ? cached->exactNearest.data() : nullptr;
+        refcon.width = fieldWidth;
+        refcon.height = fieldHeight;
+
+        refcon.bands = (fieldWidth + EXACT_BAND_COLUMNS - 1) / EXACT_BAND_COLUMNS;
+        ERR(iterateSuite->iterate_generic(planes * refcon.bands, &refcon,
+                                          ExactColumnBand));
+
+        refcon.bands = (fieldHeight + MASK_BAND_ROWS - 1) / MASK_BAND_ROWS;
+        ERR(iterateSuite->iterate_generic(planes * refcon.bands, &refcon,
+                                          ExactRowBand));
+
+        cached->valid = !err;
+
+        FX_LOG_TIME_END(exactTime, "Exact distance field");
+    }
+
+    // Field -> AE pixels
+    if (!err) {
+        ExactOutputRefcon refcon;
+        refcon.in_data = in_data;
+        refcon.cached = cached;
+        refcon.fieldWidth = fieldWidth;
+        refcon.originX = outputOriginX;
+        refcon.originY = outputOriginY;
+        refcon.worldP = output_worldP;
+        refcon.format = format;
+        refcon.width = distanceWidth;
+        refcon.mode = paramInfo->mode;
+        refcon.invert = paramInfo->invert;
+        refcon.nearestVector = nearestVector;
+        refcon.perChannel = perChannel;
+
+        A_long outputBands = (output_worldP->height + MASK_BAND_ROWS - 1) / MASK_BAND_ROWS;
+        ERR(iterateSuite->iterate_generic(outputBands, &refcon, WriteExactBand));
+    }
+
+    return err;
+}
+
+// Pick the two float fbos other than the given one, among the fbos of the
+// field and the spare one
+static void GetOtherFbos(GlobalData *globalData, DistanceCache::Field *cached,
+                         OGL::Fbo *fbo, OGL::Fbo **a, OGL::Fbo **b) {
+    OGL::Fbo *fbos[] = {cached->horizontal, cached->vertical, globalData->spareFbo};
+    OGL::Fbo **dst[] = {a, b};
+
+    int n = 0;
+    for (OGL::Fbo *f : fbos) {
+        if (f != fbo && n < 2) {
+            *dst[n++] = f;
+        }
+    }
+}
+
 static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
                           PF_SmartRenderExtra *extra) {
     PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
@@ -218,8 +823,7 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
     auto handleSuite = suites.HandleSuite1();
 
     ParamInfo *paramInfo =
-        reinterpret_cast<ParamInfo *>(handleSuite->host_lock_handle(
-            reinterpret_cast<PF_Handle>(extra->input->pre_render_data)));
+        reinterpret_cast<ParamInfo *>(extra->input->pre_render_data);
 
     // Checkout layer pixels
     ERR((extra->cb->checkout_layer_pixels(in_data->effect_ref, PARAM_INPUT,
@@ -238,10 +842,7 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
     auto *globalData = reinterpret_cast<GlobalData *>(
         handleSuite->host_lock_handle(in_data->global_data));
 
-    // OpenGL
     if (!err) {
-        globalData->globalContext.bind();
-
         GLenum pixelType;
         switch (format) {
             case PF_PixelFormat_ARGB32:
@@ -255,98 +856,247 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
                 break;
         }
 
-        GLsizei width = input_worldP->width;
-        GLsizei height = input_worldP->height;
+        GLsizei width = output_worldP->width;
+        GLsizei height = output_worldP->height;
+        GLsizei inputWidth = input_worldP->width;
+        GLsizei inputHeight = input_worldP->height;
         size_t pixelBytes = AEOGLInterop::getPixelBytes(pixelType);
 
-        GLfloat infinityValue = 30000.0f;
-        //glGetMinmax(GL_MINMAX, GL_TRUE, GL_RGBA, GL_FLOAT, &maxValue);
-
-        // Setup render context
-        globalData->fboA.allocate(width, height, GL_RG, GL_FLOAT);
-        globalData->fboB.allocate(width, height, GL_RG, GL_FLOAT);
-        globalData->outputFbo.allocate(width, height, GL_RGBA, pixelType);
-        globalData->inputTexture.allocate(width, height, GL_RGBA, pixelType);
-
-        // Allocate pixels buffer
-        PF_Handle pixelsBufferH =
-            handleSuite->host_new_handle(width * height * pixelBytes);
-        void *pixelsBufferP = reinterpret_cast<char *>(
-            handleSuite->host_lock_handle(pixelsBufferH));
-
-        // Upload buffer to OpenGL texture
-        AEOGLInterop::uploadTexture(&globalData->inputTexture,
-                                    input_worldP, pixelsBufferP, pixelType);
-
-        float multiplier16bit = AEOGLInterop::getMultiplier16bit(pixelType);
-
         // TODO: Support non-uniform downsampling
         float downsampleX = (float)in_data->downsample_x.num / in_data->downsample_x.den;
-        // float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
+        float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
+
+        // The field covers the input and the requested output within reach
+        // of it, so that the seeds just outside of the output still reach
+        // into it. The reach is rounded up rather than following Width.
+        A_long marginX = (A_long)std::ceil(paramInfo->width * downsampleX);
+        A_long marginY = (A_long)std::ceil(paramInfo->width * downsampleY);
+        marginX = (marginX + FIELD_MARGIN_STEP - 1) / FIELD_MARGIN_STEP * FIELD_MARGIN_STEP;
+        marginY = (marginY + FIELD_MARGIN_STEP - 1) / FIELD_MARGIN_STEP * FIELD_MARGIN_STEP;
+
+        PF_LRect fieldRect = paramInfo->inputRect;
+        AEUtils::growRect(&fieldRect, marginX, marginY);
+        AEUtils::intersectRect(&paramInfo->requestRect, &fieldRect);
+        UnionLRect(&paramInfo->inputRect, &fieldRect);
+        UnionLRect(&paramInfo->outputRect, &fieldRect);
+
+        A_long inputOriginX = paramInfo->inputRect.left - fieldRect.left;
+        A_long inputOriginY = paramInfo->inputRect.top - fieldRect.top;
+        A_long outputOriginX = paramInfo->outputRect.left - fieldRect.left;
+        A_long outputOriginY = paramInfo->outputRect.top - fieldRect.top;
+
+        GLsizei fieldRectWidth = fieldRect.right - fieldRect.left;
+        GLsizei fieldRectHeight = fieldRect.bottom - fieldRect.top;
 
         int distanceWidth = paramInfo->width * downsampleX;
 
-        // input -> float
-        globalData->fboA.bind();
-        globalData->thresholdShader.bind();
-        globalData->thresholdShader.setTexture("tex0", &globalData->inputTexture, 0);
-        globalData->thresholdShader.setFloat("multiplier16bit", multiplier16bit);
-        globalData->thresholdShader.setFloat("infinity", infinityValue);
-        globalData->thresholdShader.setInt("source", paramInfo->source);
-        globalData->quad.render();
-
-        // Compute distance
-        globalData->distanceShader.bind();
-
-        OGL::Fbo *fboSrc = &globalData->fboA;
-        OGL::Fbo *fboDst = &globalData->fboB;
-
-        // Horizontal
-        for (int i = 0; i < distanceWidth; i++) {
-            float beta = 2 * i + 1;
-
-            fboDst->bind();
-            globalData->distanceShader.setTexture("tex0", fboSrc->getTexture(), 0);
-            globalData->distanceShader.setFloat("beta", beta);
-            globalData->distanceShader.setVec2("offset", 1.0f / (float)width, 0.0f);
-            globalData->quad.render();
-
-            OGL::Fbo *swap = fboDst;
-            fboDst = fboSrc;
-            fboSrc = swap;
+        // Beyond the reach of the float field, compute it exactly on the CPU.
+        // The nearest pixels are only tracked by the exact field as well.
+        bool exact = paramInfo->precision == PRECISION_INTEGER ||
+                     paramInfo->output == OUTPUT_NEAREST_VECTOR ||
+                     distanceWidth > FLOAT_FIELD_MAX_DISTANCE;
+
+        // In draft quality, propagate the distance at half resolution with
+        // half-float precision so that the number of passes and the bandwidth
+        // per pass both drop while the user is scrubbing, within the same
+        // pass cap as otherwise
+        bool draft = AEUtils::isDraftQuality(in_data) && !exact;
+        int fieldScale = draft ? 2 : 1;
+        int passes = distanceWidth / fieldScale;
+
+        // Choose the intermediate storage. Packing stores the signed squared
+        // distance in a single channel, half-float halves each channel.
+        A_long precision = draft ? PRECISION_HALF_PACKED : paramInfo->precision;
+
+        // Per Channel propagates the fields of R, G, B and A together in the
+        // four lanes of packed fields
+        bool perChannel = paramInfo->source == SOURCE_PER_CHANNEL;
+        bool packed = precision == PRECISION_FLOAT_PACKED ||
+                      precision == PRECISION_HALF_PACKED || perChannel;
+        bool half = precision == PRECISION_HALF ||
+                    precision == PRECISION_HALF_PACKED;
+
+        // Rounding errors of half-floats accumulate over passes, so fall back
+        // to float beyond the reach where they stay below a fraction of pixel.
+        // Draft falls back to Float (Packed), as its error would otherwise
+        // double again in output pixels.
+        if (half && passes > HALF_FLOAT_MAX_PASSES) {
+            half = false;
         }
 
-        // Vertical
-        for (int i = 0; i < distanceWidth; i++) {
-            float beta = 2 * i + 1;
-
-            fboDst->bind();
-            globalData->distanceShader.setTexture("tex0", fboSrc->getTexture(), 0);
-            globalData->distanceShader.setFloat("beta", beta);
-            globalData->distanceShader.setVec2("offset", 0.0, 1.0f / (float)height);
-            globalData->quad.render();
+        GLenum fieldFormat = perChannel ? GL_RGBA : packed || exact ? GL_RED : GL_RG;
+        GLenum fieldType = exact ? GL_UNSIGNED_INT : half ? GL_HALF_FLOAT : GL_FLOAT;
+
+        GLsizei fieldWidth = (fieldRectWidth + fieldScale - 1) / fieldScale;
+        GLsizei fieldHeight = (fieldRectHeight + fieldScale - 1) / fieldScale;
+
+        // Key of the field, to look up the cached one
+        DistanceCache::Key cacheKey;
+        cacheKey.input = AEOGLInterop::TextureCache::makeKey(input_worldP, GL_RGBA,
+                                                             pixelType);
+        cacheKey.source = paramInfo->source;
+        cacheKey.originX = inputOriginX;
+        cacheKey.originY = inputOriginY;
+        cacheKey.downsampleX = in_data->downsample_x;
+        cacheKey.downsampleY = in_data->downsample_y;
+        cacheKey.fieldWidth = fieldWidth;
+        cacheKey.fieldHeight = fieldHeight;
+        cacheKey.fieldFormat = fieldFormat;
+        cacheKey.fieldType = fieldType;
+        cacheKey.nearest = exact && paramInfo->output == OUTPUT_NEAREST_VECTOR &&
+                           !perChannel;
+
+        // Releasing cached fields may delete fbos, in either path
+        globalData->globalContext.bind();
 
-            OGL::Fbo *swap = fboDst;
-            fboDst = fboSrc;
-            fboSrc = swap;
+        if (exact) {
+            ERR(RenderExact(in_data, globalData, paramInfo, input_worldP,
+                            output_worldP, format, cacheKey, outputOriginX,
+                            outputOriginY, (float)distanceWidth));
+        } else {
+            GLfloat infinityValue = 30000.0f;
+            //glGetMinmax(GL_MINMAX, GL_TRUE, GL_RGBA, GL_FLOAT, &maxValue);
+
+            // Two fbos of the field, each as large as the field itself
+            size_t channelBytes = half ? sizeof(uint16_t) : sizeof(float);
+            size_t fieldBytes = 2 * (size_t)fieldWidth * fieldHeight *
+                                (perChannel ? 4 : packed ? 1 : 2) * channelBytes;
+            DistanceCache::Field *cached =
+                globalData->distanceCache.getField(cacheKey, fieldBytes);
+
+            // Setup render context
+            globalData->spareFbo->allocate(fieldWidth, fieldHeight, fieldFormat, fieldType);
+            globalData->outputFbo.allocate(width, height, GL_RGBA, pixelType);
+
+            // Allocate pixels buffer
+            size_t pixelsBufferSize = std::max(width * height, inputWidth * inputHeight) *
+                                      pixelBytes;
+            PF_Handle pixelsBufferH = handleSuite->host_new_handle(pixelsBufferSize);
+            void *pixelsBufferP = reinterpret_cast<char *>(
+                handleSuite->host_lock_handle(pixelsBufferH));
+
+            float multiplier16bit = AEOGLInterop::getMultiplier16bit(pixelType);
+
+            if (!cached->valid) {
+                if (!cached->horizontal) {
+                    cached->horizontal = new OGL::Fbo();
+                    cached->vertical = new OGL::Fbo();
+                    cached->horizontal->allocate(fieldWidth, fieldHeight, fieldFormat,
+                                                 fieldType);
+                    cached->vertical->allocate(fieldWidth, fieldHeight, fieldFormat,
+                                               fieldType);
+                }
+
+                // Upload the inside/outside mask, unless it is already resident
+                OGL::Texture *maskTexture = nullptr;
+                ERR(GetMaskTexture(in_data, globalData, cacheKey.input, input_worldP,
+                                   format, paramInfo->source, pixelsBufferP,
+                                   &maskTexture));
+
+                if (!err) {
+                    // mask -> float
+                    cached->horizontal->bind();
+                    globalData->thresholdShader.bind();
+                    globalData->thresholdShader.setTexture("tex0", maskTexture, 0);
+                    globalData->thresholdShader.setFloat("infinity", infinityValue);
+                    globalData->thresholdShader.setInt("packed", packed ? 1 : 0);
+                    globalData->thresholdShader.setInt("channels", perChannel ? 4 : 1);
+                    globalData->thresholdShader.setVec2("fieldSize",
+                                                        (float)(fieldWidth * fieldScale),
+                                                        (float)(fieldHeight * fieldScale));
+                    globalData->thresholdShader.setVec2("inputSize", (float)inputWidth,
+                                                        (float)inputHeight);
+                    globalData->thresholdShader.setVec2("inputOrigin", (float)inputOriginX,
+                                                        (float)inputOriginY);
+                    globalData->quad.render();
+
+                    cached->valid = true;
+                    cached->passes = 0;
+                    cached->field = nullptr;
+                }
+            }
+
+            // Compute distance, only when the cached field doesn't reach Width yet
+            if (!err && (passes > cached->passes || !cached->field)) {
+                globalData->distanceShader.bind();
+                globalData->distanceShader.setInt("packed", packed ? 1 : 0);
+
+                OGL::Fbo *fboSrc, *fboDst, *fboSpare;
+                A_long totalPasses = (passes - cached->passes) + passes;
+
+                // Continue the horizontal passes from where the cache left off,
+                // ping-ponging between the two fbos of the field
+                fboSrc = cached->horizontal;
+                GetOtherFbos(globalData, cached, fboSrc, &fboDst, &fboSpare);
+
+                ERR(RenderDistancePasses(in_data, globalData, &fboSrc, &fboDst,
+                                         cached->passes, passes,
+                                         1.0f / (float)fieldWidth, 0.0f,
+                                         0, totalPasses));
+
+                if (fboSrc != cached->horizontal) {
+                    std::swap(cached->horizontal, cached->vertical);
+                }
+
+                // Run all vertical passes again, keeping the horizontal field
+                // intact by never writing back into it
+                GetOtherFbos(globalData, cached, cached->horizontal, &fboDst, &fboSpare);
+
+                ERR(RenderDistancePasses(in_data, globalData, &fboSrc, &fboDst,
+                                         0, std::min(passes, 1),
+                                         0.0f, 1.0f / (float)fieldHeight,
+                                         passes - cached->passes, totalPasses));
+                fboDst = fboSpare;
+                ERR(RenderDistancePasses(in_data, globalData, &fboSrc, &fboDst,
+                                         1, passes,
+                                         0.0f, 1.0f / (float)fieldHeight,
+                                         passes - cached->passes + 1, totalPasses));
+
+                // The field keeps the fbo the passes ended in, and hands the
+                // other one over as the spare
+                if (fboSrc == globalData->spareFbo) {
+                    std::swap(cached->vertical, globalData->spareFbo);
+                }
+
+                if (err) {
+                    // Aborted halfway, so the cached field is incomplete
+                    cached->valid = false;
+                } else {
+                    cached->passes = std::max(passes, cached->passes);
+                    cached->field = fboSrc;
+                }
+            }
+
+            // Back to AE texture
+            if (!err) {
+                globalData->outputFbo.bind();
+                globalData->outputShader.bind();
+                globalData->outputShader.setTexture("tex0", cached->field->getTexture(), 0);
+                globalData->outputShader.setFloat("multiplier16bit", multiplier16bit);
+                globalData->outputShader.setFloat("width", (float)distanceWidth);
+                globalData->outputShader.setFloat("fieldScale", (float)fieldScale);
+                globalData->outputShader.setVec2("fieldSize",
+                                                 (float)(fieldWidth * fieldScale),
+                                                 (float)(fieldHeight * fieldScale));
+                globalData->outputShader.setVec2("outputSize", (float)width, (float)height);
+                globalData->outputShader.setVec2("outputOrigin", (float)outputOriginX,
+                                                 (float)outputOriginY);
+                globalData->outputShader.setInt("mode", paramInfo->mode);
+                globalData->outputShader.setInt("packed", packed ? 1 : 0);
+                globalData->outputShader.setInt("channels", perChannel ? 4 : 1);
+                globalData->outputShader.setInt("invert", paramInfo->invert ? 1 : 0);
+                globalData->quad.render();
+
+                // Read pixels
+                globalData->outputFbo.readToPixels(pixelsBufferP);
+                ERR(AEOGLInterop::downloadTexture(pixelsBufferP, output_worldP, pixelType));
+            }
+
+            handleSuite->host_unlock_handle(pixelsBufferH);
+            handleSuite->host_dispose_handle(pixelsBufferH);
         }
 
-        // Back to AE texture
-        globalData->outputFbo.bind();
-        globalData->outputShader.bind();
-        globalData->outputShader.setTexture("tex0", fboSrc->getTexture(), 0);
-        globalData->outputShader.setFloat("multiplier16bit", multiplier16bit);
-        globalData->outputShader.setFloat("width", (float)distanceWidth);
-        globalData->outputShader.setInt("mode", paramInfo->mode);
-        globalData->outputShader.setInt("invert", paramInfo->invert ? 1 : 0);
-        globalData->quad.render();
-
-        // Read pixels
-        globalData->outputFbo.readToPixels(pixelsBufferP);
-        ERR(AEOGLInterop::downloadTexture(pixelsBufferP, output_worldP, pixelType));
-
-        handleSuite->host_unlock_handle(pixelsBufferH);
-        handleSuite->host_dispose_handle(pixelsBufferH);
+        globalData->distanceCache.trim();
     }
 
     // Check in
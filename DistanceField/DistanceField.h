@@ -31,6 +31,11 @@ typedef unsigned short PixelType;
 #include "AEGP_SuiteHandler.h"
 
 #include "OGL.h"
+#include "TextureCache.hpp"
+#include "DistanceTransform.hpp"
+#include "PreRenderPool.hpp"
+
+#include <vector>
 
 /* Other useful constants */
 #define PF_MAX_CHAN32 1.0f
@@ -45,20 +50,209 @@ typedef unsigned short PixelType;
 
 /* Parameter defaults */
 
+// Number of distance passes between checks for abort requests
+#define ABORT_CHECK_INTERVAL 8
+
+// Number of rows thresholded per job when building the input mask
+#define MASK_BAND_ROWS 32
+
 enum { PARAM_INPUT = 0,
        PARAM_MODE,
        PARAM_WIDTH,
        PARAM_SOURCE,
        PARAM_INVERT,
+       PARAM_PRECISION,
+       PARAM_OUTPUT,
        PARAM_NUM_PARAMS };
 
+enum { MODE_INSIDE = 1,
+       MODE_OUTSIDE,
+       MODE_BOTH_SIGNED,
+       MODE_BOTH_ABS };
+
+enum { SOURCE_LUMA = 1,
+       SOURCE_ALPHA,
+       SOURCE_PER_CHANNEL };
+
+enum { OUTPUT_DISTANCE = 1,
+       OUTPUT_NEAREST_VECTOR };
+
+enum { PRECISION_FLOAT = 1,
+       PRECISION_FLOAT_PACKED,
+       PRECISION_HALF,
+       PRECISION_HALF_PACKED,
+       PRECISION_INTEGER };
+
+// Half-float rounding accumulates along the propagation chain. The largest
+// error against the exact field, as measured by tests/HalfFloatError.cpp over
+// a set of masks, for both Half and Half (Packed):
+//
+//     Width (px)   48      64      72      96      128     256
+//     error (px)   0.14    0.35    0.56    0.81    1.71    5.75
+//
+// so half-floats are only used up to the widest reach within half a pixel,
+// counted in passes, so that draft at half resolution reaches twice as far.
+#define HALF_FLOAT_MAX_PASSES 64
+
+// The float field stores squared distances scaled by 1/1024 and encodes
+// infinity as 30000, so that it reaches ~5500px at most, and its spacing of
+// squared distances exceeds 1px^2 beyond ~2900px. Wider fields are computed
+// with exact integer squared distances on the CPU instead.
+#define FLOAT_FIELD_MAX_DISTANCE 2048
+
+// Number of columns per job in the column pass of the exact field
+#define EXACT_BAND_COLUMNS 256
+
+// Reach of the field around the input, rounded up to a multiple of this so
+// that the field keeps its size, and the cached one stays valid, while Width
+// is dragged within a step
+#define FIELD_MARGIN_STEP 128
+
+// Memory budget for cached fields, on the GPU and the CPU alike
+#define DISTANCE_CACHE_BUDGET (256 * 1024 * 1024)
+
+// Keeps the unclamped squared distance fields of the last rendered inputs.
+// Mode, Invert and Width only change how a field is mapped to the output, so
+// the threshold and distance passes can be skipped while they are tweaked.
+// Fields are kept per input, so that instances don't evict each other, and
+// the least recently used are released beyond DISTANCE_CACHE_BUDGET.
+class DistanceCache {
+   public:
+    struct Key {
+        AEOGLInterop::TextureCache::Key input;
+        A_long source;
+        A_long originX, originY;  // Offset of the input within the field
+        PF_RationalScale downsampleX, downsampleY;
+        GLsizei fieldWidth, fieldHeight;
+        GLenum fieldFormat, fieldType;
+        bool nearest;  // Whether the exact field tracks the nearest pixels
+
+        bool operator==(const Key &k) const {
+            return input == k.input && source == k.source &&
+                   originX == k.originX && originY == k.originY &&
+                   downsampleX.num == k.downsampleX.num &&
+                   downsampleX.den == k.downsampleX.den &&
+                   downsampleY.num == k.downsampleY.num &&
+                   downsampleY.den == k.downsampleY.den &&
+                   fieldWidth == k.fieldWidth && fieldHeight == k.fieldHeight &&
+                   fieldFormat == k.fieldFormat && fieldType == k.fieldType &&
+                   nearest == k.nearest;
+        }
+    };
+
+    struct Field {
+        bool valid = false;
+
+        // Number of passes run per axis. The field is exact for distances up
+        // to this reach, so it can be reused for any smaller Width, and can be
+        // extended by continuing the horizontal passes when Width grows.
+        int passes = 0;
+
+        // Fbos owned by the field, one after the horizontal passes only, and
+        // one the vertical passes end in
+        OGL::Fbo *horizontal = nullptr;
+        OGL::Fbo *vertical = nullptr;
+
+        // Field after both passes, either of the above, or nullptr until the
+        // passes have run
+        OGL::Fbo *field = nullptr;
+
+        // Exact field computed on the CPU, one byte of mask and one squared
+        // distance per pixel, both laid out top-down, in a plane per channel
+        // for Per Channel. The index of the nearest pixel of the other class
+        // is only kept when the vector output needs it.
+        std::vector<uint8_t> exactMask;
+        std::vector<uint32_t> exactField;
+        std::vector<uint32_t> exactNearest;
+
+        ~Field() {
+            delete this->horizontal;
+            delete this->vertical;
+        }
+    };
+
+    DistanceCache(size_t budgetBytes = DISTANCE_CACHE_BUDGET)
+        : budgetBytes(budgetBytes) {}
+
+    ~DistanceCache() {
+        this->clear();
+    }
+
+    // Returns the field kept for the key, or a new invalid one, releasing
+    // least recently used fields to make room for the bytes it takes
+    Field *getField(const Key &key, size_t bytes) {
+        for (auto &entry : this->entries) {
+            if (entry.key == key) {
+                entry.lastUsed = ++this->clock;
+                return entry.field;
+            }
+        }
+
+        this->evict(bytes);
+
+        Entry entry;
+        entry.key = key;
+        entry.field = new Field();
+        entry.bytes = bytes;
+        entry.lastUsed = ++this->clock;
+
+        this->entries.push_back(entry);
+        this->usedBytes += bytes;
+
+        return entry.field;
+    }
+
+    // Releases fields beyond the budget, down to the one used last, once it
+    // has been rendered from. A field larger than the budget is not kept.
+    void trim() {
+        this->evict(0);
+    }
+
+    void clear() {
+        for (auto &entry : this->entries) {
+            delete entry.field;
+        }
+        this->entries.clear();
+        this->usedBytes = 0;
+    }
+
+   private:
+    struct Entry {
+        Key key;
+        Field *field = nullptr;
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    std::vector<Entry> entries;
+    size_t budgetBytes = 0, usedBytes = 0;
+    uint64_t clock = 0;
+
+    void evict(size_t incomingBytes) {
+        while (!this->entries.empty() &&
+               this->usedBytes + incomingBytes > this->budgetBytes) {
+            auto lru = this->entries.begin();
+            for (auto it = this->entries.begin(); it != this->entries.end(); it++) {
+                if (it->lastUsed < lru->lastUsed) {
+                    lru = it;
+                }
+            }
+
+            delete lru->field;
+            this->usedBytes -= lru->bytes;
+            this->entries.erase(lru);
+        }
+    }
+};
+
 struct GlobalData {
     OGL::GlobalContext globalContext;
-    OGL::Texture inputTexture;
+    AEOGLInterop::TextureCache inputTextureCache;
     OGL::Shader thresholdShader, distanceShader, outputShader;
-    OGL::Fbo outputFbo;   // Pixel type obo
-    OGL::Fbo fboA, fboB;  // Float fbo
+    OGL::Fbo outputFbo;  // Pixel type obo
+    OGL::Fbo *spareFbo;  // Float fbo the passes ping-pong through, besides the field's
     OGL::QuadVao quad;
+    DistanceCache distanceCache;
 };
 
 struct ParamInfo {
@@ -66,6 +260,12 @@ struct ParamInfo {
     PF_FpLong width;
     A_long source;
     PF_Boolean invert;
+    A_long precision;
+    A_long output;
+
+    // Rects of the checked out input, the output and the requested output
+    // in layer coordinates
+    PF_LRect inputRect, outputRect, requestRect;
 };
 
 extern "C" {
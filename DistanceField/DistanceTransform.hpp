@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Squared distance of pixels with no pixel of the other class in the field
+#define DISTANCE_INFINITY UINT32_MAX
+
+// Nearest seed index of pixels with no pixel of the other class in the field
+#define NEAREST_NONE UINT32_MAX
+
+namespace DistanceTransform {
+
+// Exact Euclidean distance transform on the CPU, after Meijster et al.
+// "A General Algorithm for Computing Distance Transforms in Linear Time".
+//
+// The mask holds one byte per pixel, non-zero inside. For each pixel, the
+// field receives the squared distance to the nearest pixel of the other
+// class, i.e. to the nearest inside pixel for outside pixels and vice versa.
+// Squared distances are kept as integers, so the result is exact at any
+// reach, and each pass is linear in the number of pixels regardless of it.
+//
+// Optionally, the nearest pixel of the other class itself is tracked along,
+// as its index y * width + x, to be written to nearestP.
+//
+// Both passes work on independent bands so that they can be run in parallel:
+// columnPass on ranges of columns, then rowPass on ranges of rows.
+
+// Distances in the 1D passes of pixels with nothing to reach
+static const int64_t INFINITE_DISTANCE = (int64_t)1 << 40;
+
+// Vertical distance to the nearest pixel of the other class within the same
+// column, for the columns [xStart, xEnd). Rows are scanned top-down then
+// bottom-up, so the memory is walked in row order.
+inline void columnPass(const uint8_t *maskP, uint32_t *fieldP,
+                       uint32_t *nearestP, int width, int height, int xStart,
+                       int xEnd) {
+    const uint32_t infinity = std::numeric_limits<uint32_t>::max();
+
+    // Top-down: distance to the nearest transition above
+    for (int x = xStart; x < xEnd; x++) {
+        fieldP[x] = infinity;
+    }
+
+    for (int y = 1; y < height; y++) {
+        const uint8_t *maskRowP = maskP + (size_t)y * width;
+        uint32_t *fieldRowP = fieldP + (size_t)y * width;
+
+        for (int x = xStart; x < xEnd; x++) {
+            uint32_t above = fieldRowP[x - width];
+
+            if ((maskRowP[x] != 0) != (maskRowP[x - width] != 0)) {
+                fieldRowP[x] = 1;
+            } else {
+                fieldRowP[x] = above == infinity ? infinity : above + 1;
+            }
+        }
+    }
+
+    // Bottom-up: take the nearer of both and square it
+    std::vector<uint32_t> below(xEnd - xStart, infinity);
+
+    for (int y = height - 1; y >= 0; y--) {
+        const uint8_t *maskRowP = maskP + (size_t)y * width;
+        uint32_t *fieldRowP = fieldP + (size_t)y * width;
+
+        for (int x = xStart; x < xEnd; x++) {
+            uint32_t &b = below[x - xStart];
+
+            if (y < height - 1) {
+                if ((maskRowP[x] != 0) != (maskRowP[x + width] != 0)) {
+                    b = 1;
+                } else if (b != infinity) {
+                    b++;
+                }
+            }
+
+            uint32_t a = fieldRowP[x];
+            uint32_t d = std::min(a, b);
+            fieldRowP[x] = d == infinity ? DISTANCE_INFINITY : d * d;
+
+            if (nearestP) {
+                int nearestY = d == infinity ? -1 : a <= b ? y - (int)a : y + (int)b;
+                nearestP[(size_t)y * width + x] =
+                    nearestY < 0 ? NEAREST_NONE : (uint32_t)nearestY * width + x;
+            }
+        }
+    }
+}
+
+// Lower envelope of the parabolas (x - i)^2 + g(i), evaluated at every x.
+// Separators are computed with 64-bit integer floor divisions, so ties are
+// resolved exactly and no floating point rounding is involved.
+class Envelope {
+   public:
+    void resize(int width) {
+        this->s.resize(width);
+        this->t.resize(width);
+    }
+
+    template <typename G, typename Store>
+    void compute(int width, G g, Store store) {
+        int *s = this->s.data();
+        int *t = this->t.data();
+
+        int q = 0;
+        s[0] = 0;
+        t[0] = 0;
+
+        for (int u = 1; u < width; u++) {
+            int64_t gu = g(u);
+
+            while (q >= 0 && f(t[q], s[q], g(s[q])) > f(t[q], u, gu)) {
+                q--;
+            }
+
+            if (q < 0) {
+                q = 0;
+                s[0] = u;
+            } else {
+                int64_t w = 1 + sep(s[q], u, g(s[q]), gu);
+                if (w < width) {
+                    q++;
+                    s[q] = u;
+                    t[q] = (int)w;
+                }
+            }
+        }
+
+        for (int u = width - 1; u >= 0; u--) {
+            store(u, f(u, s[q], g(s[q])), s[q]);
+            if (u == t[q]) {
+                q--;
+            }
+        }
+    }
+
+   private:
+    std::vector<int> s, t;
+
+    static int64_t f(int64_t x, int64_t i, int64_t gi) {
+        return (x - i) * (x - i) + gi;
+    }
+
+    static int64_t sep(int64_t i, int64_t u, int64_t gi, int64_t gu) {
+        int64_t n = u * u - i * i + gu - gi;
+        int64_t d = 2 * (u - i);
+        return n >= 0 ? n / d : -((-n + d - 1) / d);
+    }
+};
+
+// Horizontal pass over the rows [yStart, yEnd), turning the vertical squared
+// distances from columnPass into the 2D squared distances in place. Each row
+// is run twice, once towards inside pixels and once towards outside pixels.
+inline void rowPass(const uint8_t *maskP, uint32_t *fieldP, uint32_t *nearestP,
+                    int width, int yStart, int yEnd) {
+    Envelope envelope;
+    envelope.resize(width);
+
+    std::vector<int64_t> g(width);
+    std::vector<uint32_t> columnNearest(nearestP ? width : 0);
+
+    for (int y = yStart; y < yEnd; y++) {
+        const uint8_t *maskRowP = maskP + (size_t)y * width;
+        uint32_t *fieldRowP = fieldP + (size_t)y * width;
+        uint32_t *nearestRowP = nearestP ? nearestP + (size_t)y * width : nullptr;
+
+        // Keep the nearest seeds within the columns, as the row is
+        // overwritten while the envelope is evaluated
+        if (nearestP) {
+            std::copy(nearestRowP, nearestRowP + width, columnNearest.begin());
+        }
+
+        for (int seedInside = 0; seedInside < 2; seedInside++) {
+            // Pixels of the seed class are at distance zero from themselves,
+            // the others carry their vertical distance to the seed class
+            for (int x = 0; x < width; x++) {
+                bool inside = maskRowP[x] != 0;
+                if (inside == (seedInside == 1)) {
+                    g[x] = 0;
+                } else if (fieldRowP[x] == DISTANCE_INFINITY) {
+                    g[x] = INFINITE_DISTANCE;
+                } else {
+                    g[x] = fieldRowP[x];
+                }
+            }
+
+            envelope.compute(
+                width, [&](int i) { return g[i]; },
+                [&](int x, int64_t d, int nearest) {
+                    bool inside = maskRowP[x] != 0;
+                    if (inside == (seedInside == 1)) {
+                        return;
+                    }
+
+                    bool none = d >= INFINITE_DISTANCE;
+                    fieldRowP[x] = none ? DISTANCE_INFINITY : (uint32_t)d;
+
+                    if (nearestRowP) {
+                        // The nearest site is either a seed itself, or
+                        // leads to its nearest seed within its column
+                        bool seed = (maskRowP[nearest] != 0) == (seedInside == 1);
+                        nearestRowP[x] =
+                            none ? NEAREST_NONE
+                            : seed ? (uint32_t)((size_t)y * width + nearest)
+                                   : columnNearest[nearest];
+                    }
+                });
+        }
+    }
+}
+
+}  // namespace DistanceTransform
@@ -5,13 +5,34 @@
 uniform sampler2D tex0;
 uniform float beta;
 uniform vec2 offset;
+uniform int packed;
 
 in vec2 uv;
 out vec4 fragColor;
 
+// In packed fields, each lane holds the signed squared distance, positive
+// outside and negative inside. A neighbor on the other side is itself a seed,
+// so it contributes zero distance.
+vec4 propagate(vec4 a, vec4 n, vec4 scaledBeta) {
+    vec4 sameSide = vec4(equal(sign(a), sign(n)));
+    return abs(n) * sameSide + scaledBeta;
+}
+
 void main() {
     // https://prideout.net/blog/distance_fields/distance.txt
 
+    if (packed == 1) {
+        vec4 scaledBeta = vec4(beta / SCALE);
+
+        vec4 A = texture(tex0, uv);
+        vec4 e = propagate(A, texture(tex0, uv + offset), scaledBeta);
+        vec4 w = propagate(A, texture(tex0, uv - offset), scaledBeta);
+        vec4 B = sign(A) * min(min(abs(A), e), w);
+
+        fragColor = B;
+        return;
+    }
+
     vec2 scaledBeta = vec2(beta / SCALE);
 
     vec2 A = texture(tex0, uv).rg;
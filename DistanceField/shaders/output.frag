@@ -5,6 +5,12 @@
 uniform sampler2D tex0;
 uniform float multiplier16bit;
 uniform float width;
+uniform float fieldScale;
+
+// Placement of the output within the field, in AE pixel coordinates
+uniform vec2 fieldSize;
+uniform vec2 outputSize;
+uniform vec2 outputOrigin;
 
 uniform int mode;
 #define MODE_INSIDE         1
@@ -13,6 +19,8 @@ uniform int mode;
 #define MODE_BOTH_ABS       4
 
 uniform int invert;
+uniform int packed;
+uniform int channels;
 
 in vec2 uv;
 out vec4 fragColor;
@@ -21,23 +29,47 @@ vec4 toAE(vec4 color) {
     return color.argb / multiplier16bit;
 }
 
-void main() {
-    vec2 distSquared = texture(tex0, uv).rg * SCALE;
-    vec2 dist = sqrt(distSquared);
-    vec2 normDist = dist / width;
-
-    float luma = 0.0;
+// Map the normalized distances to luma, in each lane
+vec4 toLuma(vec4 outside, vec4 inside) {
+    vec4 luma;
 
     if (mode == MODE_INSIDE) {
-        luma = normDist.g;
+        luma = inside;
     } else if (mode == MODE_OUTSIDE) {
-        luma = normDist.r;
+        luma = outside;
     } else if (mode == MODE_BOTH_SIGNED) {
-        luma = 0.5 + (normDist.r - normDist.g) / 2.0;
+        luma = 0.5 + (outside - inside) / 2.0;
     } else {
-        luma = abs(normDist.r + normDist.g);
+        luma = abs(outside + inside);
     }
 
-    vec4 color = vec4(vec3(invert == 1 ? 1.0 - luma : luma), 1.0);
+    return invert == 1 ? 1.0 - luma : luma;
+}
+
+void main() {
+    vec2 coord = vec2(uv.x, 1.0 - uv.y) * outputSize + outputOrigin;
+    vec2 fieldUv = vec2(coord.x, fieldSize.y - coord.y) / fieldSize;
+
+    // Squared distances outside and inside. Packed fields of Per Channel hold
+    // one field in each lane, others only use the first lane.
+    vec4 outsideSquared, insideSquared;
+
+    if (packed == 1) {
+        vec4 d = texture(tex0, fieldUv);
+        outsideSquared = max(d, 0.0) * SCALE;
+        insideSquared = max(-d, 0.0) * SCALE;
+    } else {
+        vec2 d = texture(tex0, fieldUv).rg * SCALE;
+        outsideSquared = vec4(d.r);
+        insideSquared = vec4(d.g);
+    }
+
+    // Clamped, so that fields propagated further than Width map identically
+    vec4 outsideDist = min(sqrt(outsideSquared) * fieldScale / width, 1.0);
+    vec4 insideDist = min(sqrt(insideSquared) * fieldScale / width, 1.0);
+
+    vec4 luma = toLuma(outsideDist, insideDist);
+
+    vec4 color = channels == 4 ? luma : vec4(vec3(luma.r), 1.0);
     fragColor = toAE(color);
 }
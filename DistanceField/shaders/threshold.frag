@@ -1,30 +1,40 @@
 #version 400
 
+// 1-byte inside/outside mask, thresholded on the CPU. Per Channel masks have
+// one for each of R, G, B and A, single channel ones only R.
 uniform sampler2D tex0;
-uniform float multiplier16bit;
 uniform float infinity;
-uniform int source;
+uniform int packed;
+uniform int channels;
 
-#define SOURCE_LUMA 1
+// Placement of the input within the field, in AE pixel coordinates
+uniform vec2 fieldSize;
+uniform vec2 inputSize;
+uniform vec2 inputOrigin;
 
 in vec2 uv;
 out vec4 fragColor;
 
-vec4 fromAE(vec4 color) {
-    return color.gbar * multiplier16bit;
-}
-
 void main() {
-    vec4 color = fromAE(texture(tex0, uv));
+    vec2 coord = vec2(uv.x, 1.0 - uv.y) * fieldSize - inputOrigin;
+    vec2 inputUv = vec2(coord.x, inputSize.y - coord.y) / inputSize;
+
+    // Beyond the checked out input, everything is outside
+    vec4 value = vec4(0.0);
+    if (all(greaterThanEqual(inputUv, vec2(0.0))) &&
+        all(lessThanEqual(inputUv, vec2(1.0)))) {
+        value = texture(tex0, inputUv);
+    }
 
-    float value = color.a;
+    vec4 outside = step(value, vec4(0.5));
 
-    if (source == SOURCE_LUMA) {
-      value = dot(color.rgb, vec3(1.0 / 3.0));
+    if (packed == 1) {
+        vec4 d = (outside * 2.0 - 1.0) * infinity;
+        fragColor = channels == 4 ? d : vec4(d.r, 0.0, 0.0, 1.0);
+        return;
     }
 
-    float outside = step(color.r, 0.5);
-    vec2 mask = vec2(outside, 1.0 - outside);
+    vec2 mask = vec2(outside.r, 1.0 - outside.r);
     
     fragColor = vec4(mask * infinity, 0.0, 1.0);
 }
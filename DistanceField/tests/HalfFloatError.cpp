@@ -0,0 +1,248 @@
+// Error of the half-float distance fields against the exact one.
+//
+// Replays the GL path of DistanceField on the CPU: the threshold pass, then N
+// horizontal and N vertical passes of distance.frag, with the arithmetic in
+// single precision and every pass stored to the field type, as the fragment
+// outputs are. Both layouts are replayed, Half with the outside and inside
+// fields in two lanes and Half (Packed) with the signed field in one. Float
+// is replayed alike for reference.
+//
+// Each field is compared to the exact one of DistanceTransform, which the
+// Integer precision renders with RenderExact, after the clamp to Width of
+// output.frag. The largest error over every pixel of a set of representative
+// masks is reported per Width, in pixels. Half-floats are stored with both
+// rounding to nearest and truncation, since GL leaves the choice to the
+// implementation, and the worse of them is reported.
+//
+// HALF_FLOAT_MAX_PASSES is the largest Width measured here whose error stays
+// within HALF_FLOAT_MAX_ERROR.
+//
+//     make -C DistanceField/tests run
+
+#include "../DistanceTransform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// As in distance.frag and output.frag
+#define SCALE 1024
+
+// As in DistanceField.cpp
+#define INFINITY_VALUE 30000.0f
+
+// Largest error in pixels accepted from half-floats
+#define HALF_FLOAT_MAX_ERROR 0.5
+
+enum { STORE_FLOAT = 1,
+       STORE_HALF_NEAREST,
+       STORE_HALF_TRUNCATE };
+
+// Round a float to the nearest half-float, or towards zero
+static float storeHalf(float v, bool truncate) {
+    if (v == 0) {
+        return 0;
+    }
+
+    int e;
+    std::frexp(std::fabs(v), &e);
+
+    // 11 significant bits, down to the subnormals below 2^-14
+    float ulp = std::ldexp(1.0f, std::max(e, -13) - 11);
+    float q = v / ulp;
+    return (truncate ? std::trunc(q) : std::nearbyint(q)) * ulp;
+}
+
+static float store(float v, int storage) {
+    return storage == STORE_FLOAT ? v : storeHalf(v, storage == STORE_HALF_TRUNCATE);
+}
+
+static float sign(float v) {
+    return (float)((v > 0) - (v < 0));
+}
+
+// A field of one or two lanes per pixel
+struct Field {
+    int width, height, lanes;
+    std::vector<float> values;
+
+    float get(int x, int y, int lane) const {
+        // Fetches clamp to the edge
+        x = std::min(std::max(x, 0), this->width - 1);
+        y = std::min(std::max(y, 0), this->height - 1);
+        return this->values[((size_t)y * this->width + x) * this->lanes + lane];
+    }
+};
+
+// threshold.frag, with the mask non-zero inside
+static Field threshold(const std::vector<uint8_t> &mask, int width, int height,
+                       bool packed, int storage) {
+    Field field = {width, height, packed ? 1 : 2, {}};
+    field.values.resize(mask.size() * field.lanes);
+
+    for (size_t i = 0; i < mask.size(); i++) {
+        float outside = mask[i] ? 0.0f : 1.0f;
+
+        if (packed) {
+            field.values[i] = store((outside * 2 - 1) * INFINITY_VALUE, storage);
+        } else {
+            field.values[i * 2] = store(outside * INFINITY_VALUE, storage);
+            field.values[i * 2 + 1] = store((1 - outside) * INFINITY_VALUE, storage);
+        }
+    }
+
+    return field;
+}
+
+// One pass of distance.frag along the offset
+static void propagate(const Field &src, Field *dst, int dx, int dy, float beta,
+                      int storage) {
+    float scaledBeta = beta / SCALE;
+
+    for (int y = 0; y < src.height; y++) {
+        for (int x = 0; x < src.width; x++) {
+            float *outP = &dst->values[((size_t)y * src.width + x) * src.lanes];
+
+            if (src.lanes == 1) {
+                float a = src.get(x, y, 0);
+                float n0 = src.get(x + dx, y + dy, 0);
+                float n1 = src.get(x - dx, y - dy, 0);
+                float e = std::fabs(n0) * (sign(a) == sign(n0)) + scaledBeta;
+                float w = std::fabs(n1) * (sign(a) == sign(n1)) + scaledBeta;
+                outP[0] = store(sign(a) * std::min(std::min(std::fabs(a), e), w), storage);
+            } else {
+                for (int lane = 0; lane < 2; lane++) {
+                    float a = src.get(x, y, lane);
+                    float e = scaledBeta + src.get(x + dx, y + dy, lane);
+                    float w = scaledBeta + src.get(x - dx, y - dy, lane);
+                    outP[lane] = store(std::min(std::min(a, e), w), storage);
+                }
+            }
+        }
+    }
+}
+
+// Largest error in pixels of the GL path at the Width against the exact field
+static double measure(const std::vector<uint8_t> &mask, const std::vector<uint32_t> &exact,
+                      int width, int height, int passes, bool packed, int storage) {
+    Field a = threshold(mask, width, height, packed, storage);
+    Field b = a;
+
+    for (int i = 0; i < passes; i++) {
+        propagate(a, &b, 1, 0, 2.0f * i + 1, storage);
+        std::swap(a, b);
+    }
+
+    for (int i = 0; i < passes; i++) {
+        propagate(a, &b, 0, 1, 2.0f * i + 1, storage);
+        std::swap(a, b);
+    }
+
+    double maxError = 0;
+
+    for (size_t i = 0; i < mask.size(); i++) {
+        // output.frag reads the lane towards the other class
+        float squared = packed ? std::fabs(a.values[i])
+                               : a.values[i * 2 + (mask[i] ? 1 : 0)];
+        double distance = std::min(std::sqrt(squared * SCALE), (float)passes);
+        double exactDistance = exact[i] == DISTANCE_INFINITY
+                                   ? passes
+                                   : std::min(std::sqrt((double)exact[i]), (double)passes);
+        maxError = std::max(maxError, std::fabs(distance - exactDistance));
+    }
+
+    return maxError;
+}
+
+static std::vector<uint32_t> exactField(const std::vector<uint8_t> &mask, int width,
+                                        int height) {
+    std::vector<uint32_t> field(mask.size());
+    DistanceTransform::columnPass(mask.data(), field.data(), nullptr, width, height, 0,
+                                  width);
+    DistanceTransform::rowPass(mask.data(), field.data(), nullptr, width, 0, height);
+    return field;
+}
+
+// Masks shaped to reach the Width from both sides, on a field just large
+// enough to hold distances of that reach
+static std::vector<std::vector<uint8_t>> makeMasks(int size, std::mt19937 *rng) {
+    std::vector<std::vector<uint8_t>> masks(4, std::vector<uint8_t>((size_t)size * size));
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    struct Disk {
+        double x, y, r;
+    };
+    std::vector<Disk> blobs;
+
+    for (int k = 0; k < 6; k++) {
+        blobs.push_back({unit(*rng) * size, unit(*rng) * size, (0.05 + unit(*rng) * 0.2) * size});
+    }
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            size_t i = (size_t)y * size + x;
+            double cx = x - size / 2.0, cy = y - size / 2.0;
+
+            // Disk, as large masks are
+            masks[0][i] = cx * cx + cy * cy < size * size / 9.0;
+
+            // Overlapping blobs, curved both ways
+            for (const Disk &b : blobs) {
+                masks[1][i] |= (x - b.x) * (x - b.x) + (y - b.y) * (y - b.y) < b.r * b.r;
+            }
+
+            // Thin slanted line, as strokes are
+            masks[2][i] = std::fabs(cx * 0.6 - cy * 0.8 + size * 0.1) < 0.7;
+
+            // Sparse dots, reaching diagonally in every direction
+            masks[3][i] = unit(*rng) < 2e-4;
+        }
+    }
+
+    return masks;
+}
+
+int main() {
+    const int widths[] = {16, 32, 48, 64, 72, 80, 96, 128, 192, 256};
+    const char *maskNames = "disk, blobs, line, dots";
+
+    std::mt19937 rng(1);
+
+    std::printf("Largest error in px against the exact field, over %s\n\n", maskNames);
+    std::printf("%8s %10s %10s %14s\n", "Width", "Float", "Half", "Half (Packed)");
+
+    int maxPasses = 0;
+    bool withinError = true;
+
+    for (int width : widths) {
+        int size = std::min(2 * width + 32, 544);
+        double error[3] = {0, 0, 0};
+
+        for (const std::vector<uint8_t> &mask : makeMasks(size, &rng)) {
+            std::vector<uint32_t> exact = exactField(mask, size, size);
+
+            error[0] = std::max(error[0], measure(mask, exact, size, size, width, true,
+                                                  STORE_FLOAT));
+
+            for (int storage : {STORE_HALF_NEAREST, STORE_HALF_TRUNCATE}) {
+                error[1] = std::max(error[1], measure(mask, exact, size, size, width,
+                                                      false, storage));
+                error[2] = std::max(error[2], measure(mask, exact, size, size, width,
+                                                      true, storage));
+            }
+        }
+
+        std::printf("%8d %10.3f %10.3f %14.3f\n", width, error[0], error[1], error[2]);
+
+        withinError &= std::max(error[1], error[2]) <= HALF_FLOAT_MAX_ERROR;
+        if (withinError) {
+            maxPasses = width;
+        }
+    }
+
+    std::printf("\nHALF_FLOAT_MAX_PASSES %d (error within %.2f px)\n", maxPasses,
+                HALF_FLOAT_MAX_ERROR);
+    return 0;
+}
@@ -18,9 +18,9 @@
 #include "Param_Utils.h"
 #include "String_Utils.h"
 
-#include <memory>
+#include "ParamSchema.hpp"
 
-#define PI 3.14159265358979323864f
+#include <memory>
 
 namespace AEOGLInterop {
 
@@ -88,8 +88,8 @@ PF_Err downloadTexture(const void *pixelsBufferP,
     return err;
 }
 
-enum { GL_SPACE = 1,
-       AE_SPACE };
+using ParamSchema::GL_SPACE;
+using ParamSchema::AE_SPACE;
 
 PF_Err getPointParam(PF_InData *in_data, PF_OutData *out_data, int paramId,
                      int space, A_FloatPoint *value) {
@@ -100,7 +100,7 @@ PF_Err getPointParam(PF_InData *in_data, PF_OutData *out_data, int paramId,
     ERR(PF_CHECKOUT_PARAM(in_data, paramId, in_data->current_time,
                           in_data->time_step, in_data->time_scale, &param_def));
 
-    PF_PointParamSuite1 *pointSuite;
+    PF_PointParamSuite1 *pointSuite = nullptr;
     ERR(AEFX_AcquireSuite(in_data, out_data, kPFPointParamSuite,
                           kPFPointParamSuiteVersion1, "Couldn't load suite.",
                           (void **)&pointSuite));
@@ -109,24 +109,17 @@ PF_Err getPointParam(PF_InData *in_data, PF_OutData *out_data, int paramId,
     ERR(pointSuite->PF_GetFloatingPointValueFromPointDef(in_data->effect_ref,
                                                          &param_def, value));
 
-    float downsampleX = (float)in_data->downsample_x.num / in_data->downsample_x.den;
-    float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
-
-    if (space == GL_SPACE) {
-        // Scale size by downsample ratio
-        float width = (float)in_data->width * downsampleX;
-        float height = (float)in_data->height * downsampleY;
-
-        value->x /= width;
-        value->y = 1.0f - value->y / height;
-    } else {  // AE_SPACE
-        // Convert to actual size
-        value->x /= downsampleX;
-        value->y /= downsampleY;
+    if (!err) {
+        ParamSchema::convertPoint(in_data, space, value);
     }
 
     ERR2(PF_CHECKIN_PARAM(in_data, &param_def));
 
+    if (pointSuite) {
+        ERR2(AEFX_ReleaseSuite(in_data, out_data, kPFPointParamSuite,
+                               kPFPointParamSuiteVersion1, "Couldn't release suite."));
+    }
+
     return err;
 }
 
@@ -139,7 +132,7 @@ PF_Err getAngleParam(PF_InData *in_data, PF_OutData *out_data, int paramId,
     ERR(PF_CHECKOUT_PARAM(in_data, paramId, in_data->current_time,
                           in_data->time_step, in_data->time_scale, &param_def));
 
-    PF_AngleParamSuite1 *angleSuite;
+    PF_AngleParamSuite1 *angleSuite = nullptr;
     ERR(AEFX_AcquireSuite(in_data, out_data, kPFAngleParamSuite,
                           kPFAngleParamSuiteVersion1, "Couldn't load suite.",
                           (void **)&angleSuite));
@@ -147,11 +140,16 @@ PF_Err getAngleParam(PF_InData *in_data, PF_OutData *out_data, int paramId,
     ERR(angleSuite->PF_GetFloatingPointValueFromAngleDef(in_data->effect_ref,
                                                          &param_def, value));
 
-    if (space == GL_SPACE) {
-        *value = -*value * PI / 180.0f;
+    if (!err) {
+        ParamSchema::convertAngle(space, value);
     }
 
     ERR2(PF_CHECKIN_PARAM(in_data, &param_def));
+
+    if (angleSuite) {
+        ERR2(AEFX_ReleaseSuite(in_data, out_data, kPFAngleParamSuite,
+                               kPFAngleParamSuiteVersion1, "Couldn't release suite."));
+    }
     return err;
 }
 
@@ -10,8 +10,14 @@
 #include "AEFX_ChannelDepthTpl.h"
 #include "AEGP_SuiteHandler.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string>
 
+// Words of a row getLayerFingerprint hashes side by side
+#define FINGERPRINT_LANES 4
+
 namespace AEUtils {
 std::string getResourcesPath(PF_InData *in_data) {
     // initialize and compile the shader objects
@@ -40,4 +46,96 @@ std::string getResourcesPath(PF_InData *in_data) {
     return resourcePath;
 }
 
+// AE requests draft renders while the user is scrubbing or dragging params,
+// so effects can trade accuracy for interactive latency
+bool isDraftQuality(PF_InData *in_data) {
+    return in_data->quality == PF_Quality_LO;
+}
+
+// Expand the rect by the given margins on each side
+void growRect(PF_LRect *rect, A_long marginX, A_long marginY) {
+    rect->left -= marginX;
+    rect->top -= marginY;
+    rect->right += marginX;
+    rect->bottom += marginY;
+}
+
+bool isEmptyRect(const PF_LRect *rect) {
+    return rect->left >= rect->right || rect->top >= rect->bottom;
+}
+
+// Clip the rect to the given bounds. Rects that don't overlap become empty.
+void intersectRect(const PF_LRect *bounds, PF_LRect *rect) {
+    rect->left = std::max(rect->left, bounds->left);
+    rect->top = std::max(rect->top, bounds->top);
+    rect->right = std::min(rect->right, bounds->right);
+    rect->bottom = std::min(rect->bottom, bounds->bottom);
+
+    if (isEmptyRect(rect)) {
+        rect->left = rect->top = rect->right = rect->bottom = 0;
+    }
+}
+
+// Hash every pixel of the layer, for caches to tell whether the pixels are
+// the ones they were built from. Each row is hashed in FINGERPRINT_LANES
+// independent lanes, so that consecutive words don't wait on each other, and
+// the padding past the width is skipped. Dimensions and rowbytes are mixed in
+// as well. Reading the whole layer once still costs far less than uploading
+// it or building anything from it.
+uint64_t getLayerFingerprint(const PF_LayerDef *layerDef, size_t pixelBytes) {
+    const uint64_t k0 = 0x9E3779B97F4A7C15ULL;
+    const uint64_t k1 = 0x87C37B91114253D5ULL;
+
+    auto mix = [&](uint64_t hash, uint64_t word) {
+        hash ^= word * k0;
+        return ((hash << 31) | (hash >> 33)) * k1;
+    };
+
+    uint64_t hash = k0;
+    hash = mix(hash, (uint64_t)layerDef->width);
+    hash = mix(hash, (uint64_t)layerDef->height);
+    hash = mix(hash, (uint64_t)layerDef->rowbytes);
+    hash = mix(hash, (uint64_t)pixelBytes);
+
+    uint64_t lanes[FINGERPRINT_LANES];
+    for (int k = 0; k < FINGERPRINT_LANES; k++) {
+        lanes[k] = hash + k;
+    }
+
+    size_t usedBytes = layerDef->width * pixelBytes;
+    size_t rowWords = usedBytes / sizeof(uint64_t);
+    size_t tailBytes = usedBytes - rowWords * sizeof(uint64_t);
+
+    for (A_long y = 0; y < layerDef->height; y++) {
+        const char *row = (const char *)layerDef->data + y * layerDef->rowbytes;
+        uint64_t words[FINGERPRINT_LANES];
+        size_t i = 0;
+
+        for (; i + FINGERPRINT_LANES <= rowWords; i += FINGERPRINT_LANES) {
+            std::memcpy(words, row + i * sizeof(uint64_t), sizeof(words));
+            for (int k = 0; k < FINGERPRINT_LANES; k++) {
+                lanes[k] = mix(lanes[k], words[k]);
+            }
+        }
+
+        for (int k = 0; i < rowWords; i++, k++) {
+            std::memcpy(&words[k], row + i * sizeof(uint64_t), sizeof(uint64_t));
+            lanes[k] = mix(lanes[k], words[k]);
+        }
+
+        // Pixels narrower than a word leave a part of one at the end
+        if (tailBytes) {
+            uint64_t word = 0;
+            std::memcpy(&word, row + rowWords * sizeof(uint64_t), tailBytes);
+            lanes[0] = mix(lanes[0], word);
+        }
+    }
+
+    for (int k = 0; k < FINGERPRINT_LANES; k++) {
+        hash = mix(hash, lanes[k]);
+    }
+
+    return hash;
+}
+
 }  // namespace AEUtils
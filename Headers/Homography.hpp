@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cmath>
+
+namespace Homography {
+
+// 3x3 projective transform of 2D points in double precision, row-major, so
+// that a point (x, y) maps to (m[0] . p, m[1] . p) / (m[2] . p) with
+// p = (x, y, 1). Everything here works on the stack, so that transforms can
+// be solved per frame without allocating.
+struct Matrix {
+    double m[3][3];
+};
+
+struct Point {
+    double x, y;
+};
+
+inline Matrix identity() {
+    return {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+}
+
+inline Matrix multiply(const Matrix &a, const Matrix &b) {
+    Matrix r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] +
+                        a.m[i][2] * b.m[2][j];
+        }
+    }
+    return r;
+}
+
+inline double determinant(const Matrix &a) {
+    const double(*m)[3] = a.m;
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+           m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+           m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+// Inverse by the adjugate. Returns false and leaves the result untouched
+// when the matrix is singular.
+inline bool invert(const Matrix &a, Matrix *result) {
+    double det = determinant(a);
+
+    if (det == 0 || !std::isfinite(det)) {
+        return false;
+    }
+
+    const double(*m)[3] = a.m;
+    double s = 1 / det;
+
+    *result = {{{(m[1][1] * m[2][2] - m[1][2] * m[2][1]) * s,
+                 (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * s,
+                 (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * s},
+                {(m[1][2] * m[2][0] - m[1][0] * m[2][2]) * s,
+                 (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * s,
+                 (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * s},
+                {(m[1][0] * m[2][1] - m[1][1] * m[2][0]) * s,
+                 (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * s,
+                 (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * s}}};
+    return true;
+}
+
+// Scale so that m[2][2] is one, the form getPerspectiveTransform returns
+inline void normalize(Matrix *a) {
+    double w = a->m[2][2];
+
+    if (w == 0) {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            a->m[i][j] /= w;
+        }
+    }
+}
+
+// Homogeneous w the point maps to
+inline double weight(const Matrix &a, const Point &p) {
+    return a.m[2][0] * p.x + a.m[2][1] * p.y + a.m[2][2];
+}
+
+inline Point apply(const Matrix &a, const Point &p) {
+    double w = weight(a, p);
+    return {(a.m[0][0] * p.x + a.m[0][1] * p.y + a.m[0][2]) / w,
+            (a.m[1][0] * p.x + a.m[1][1] * p.y + a.m[1][2]) / w};
+}
+
+// Flip the sign of the matrix so that the point maps to a positive w. Points
+// map the same either way, but the sign tells the two sides of the horizon
+// apart: with the source layer oriented in front, every output pixel whose
+// inverse maps to a negative w lies behind it.
+inline void orient(Matrix *a, const Point &inFront) {
+    if (weight(*a, inFront) >= 0) {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            a->m[i][j] = -a->m[i][j];
+        }
+    }
+}
+
+// Clip the convex polygon of n points to the part in front of the horizon,
+// where the matrix maps to a w of at least minWeight. Points on the horizon
+// map to infinity, so a small positive minWeight keeps the mapped polygon
+// finite. Writes up to n + 1 points to clipped and returns their count.
+inline int clipToFront(const Matrix &a, const Point *polygon, int n,
+                       double minWeight, Point *clipped) {
+    int count = 0;
+
+    for (int i = 0; i < n; i++) {
+        const Point &p = polygon[i], &q = polygon[(i + 1) % n];
+        double wp = weight(a, p) - minWeight, wq = weight(a, q) - minWeight;
+
+        if (wp >= 0) {
+            clipped[count++] = p;
+        }
+
+        if ((wp >= 0) != (wq >= 0)) {
+            double t = wp / (wp - wq);
+            clipped[count++] = {p.x + (q.x - p.x) * t, p.y + (q.y - p.y) * t};
+        }
+    }
+
+    return count;
+}
+
+inline Matrix translate(const Point &src, const Point &dst) {
+    return {{{1, 0, dst.x - src.x}, {0, 1, dst.y - src.y}, {0, 0, 1}}};
+}
+
+// Affine transform taking the three source points to the destination ones,
+// as in cv::getAffineTransform. Returns false for collinear sources.
+inline bool affine(const Point src[3], const Point dst[3], Matrix *result) {
+    Matrix s = {{{src[0].x, src[1].x, src[2].x},
+                 {src[0].y, src[1].y, src[2].y},
+                 {1, 1, 1}}};
+    Matrix d = {{{dst[0].x, dst[1].x, dst[2].x},
+                 {dst[0].y, dst[1].y, dst[2].y},
+                 {1, 1, 1}}};
+    Matrix sInv;
+
+    if (!invert(s, &sInv)) {
+        return false;
+    }
+
+    *result = multiply(d, sInv);
+
+    // Exact zeros, rather than rounding residue, in the projective row
+    result->m[2][0] = result->m[2][1] = 0;
+    result->m[2][2] = 1;
+    return true;
+}
+
+// Projective transform taking the unit square (0, 0), (1, 0), (1, 1), (0, 1)
+// to the quad, after Heckbert, "Fundamentals of Texture Mapping and Image
+// Warping". Returns false for degenerate quads.
+inline bool squareToQuad(const Point quad[4], Matrix *result) {
+    double sx = quad[0].x - quad[1].x + quad[2].x - quad[3].x;
+    double sy = quad[0].y - quad[1].y + quad[2].y - quad[3].y;
+    double g = 0, h = 0;
+
+    // Parallelograms map affinely
+    if (sx != 0 || sy != 0) {
+        double dx1 = quad[1].x - quad[2].x, dx2 = quad[3].x - quad[2].x;
+        double dy1 = quad[1].y - quad[2].y, dy2 = quad[3].y - quad[2].y;
+        double det = dx1 * dy2 - dx2 * dy1;
+
+        if (det == 0) {
+            return false;
+        }
+
+        g = (sx * dy2 - dx2 * sy) / det;
+        h = (dx1 * sy - sx * dy1) / det;
+    }
+
+    *result = {{{quad[1].x - quad[0].x + g * quad[1].x,
+                 quad[3].x - quad[0].x + h * quad[3].x, quad[0].x},
+                {quad[1].y - quad[0].y + g * quad[1].y,
+                 quad[3].y - quad[0].y + h * quad[3].y, quad[0].y},
+                {g, h, 1}}};
+    return determinant(*result) != 0;
+}
+
+// Projective transform taking the source quad to the destination one, as in
+// cv::getPerspectiveTransform, through the unit square. Both quads run
+// around their corners in the same order. Returns false for degenerate
+// quads.
+inline bool perspective(const Point src[4], const Point dst[4],
+                        Matrix *result) {
+    Matrix srcToSquare, squareToSrc, squareToDst;
+
+    if (!squareToQuad(src, &squareToSrc) ||
+        !squareToQuad(dst, &squareToDst) ||
+        !invert(squareToSrc, &srcToSquare)) {
+        return false;
+    }
+
+    *result = multiply(squareToDst, srcToSquare);
+    normalize(result);
+    return std::isfinite(result->m[2][2]);
+}
+
+}  // namespace Homography
@@ -0,0 +1,276 @@
+#pragma once
+
+#include "PixelSampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Deepest level of a pyramid, below the world itself
+#define MIP_MAX_LEVELS 12
+
+// Most taps along the major axis of an anisotropic footprint
+#define MIP_MAX_ANISOTROPY 8
+
+// Box-filtered copies of a world, each half the size of the one above, for
+// sampling it minified without aliasing. Level 0 is the world itself, and
+// the levels below are stored in the same pixel type.
+//
+// Building is split by rows so that the caller can spread each level across
+// threads. Levels have to be built in order, since each one is filtered from
+// the one above.
+class MipPyramid {
+   public:
+    // Point level 0 at the world. A pyramid kept across renders is pointed
+    // at each new copy of the same pixels, keeping the levels below.
+    void setWorld(const PF_EffectWorld *worldP) {
+        if (this->levels.empty()) {
+            this->levels.push_back(*worldP);
+        } else {
+            this->levels[0] = *worldP;
+        }
+    }
+
+    // Allocate the levels missing below the deepest one, down to the given
+    // level or 1x1. The levels already there are kept as they are.
+    template <typename PixelType>
+    void extend(int numLevels) {
+        numLevels = std::min(numLevels, MIP_MAX_LEVELS);
+
+        for (int k = (int)this->levels.size(); k <= numLevels; k++) {
+            const PF_EffectWorld &above = this->levels.back();
+
+            if (above.width <= 1 && above.height <= 1) {
+                break;
+            }
+
+            PF_EffectWorld level = above;
+            level.width = std::max((above.width + 1) / 2, (A_long)1);
+            level.height = std::max((above.height + 1) / 2, (A_long)1);
+            level.rowbytes = (A_long)(level.width * sizeof(PixelType));
+
+            this->buffers.emplace_back((size_t)level.rowbytes * level.height);
+            level.data = reinterpret_cast<decltype(level.data)>(
+                this->buffers.back().data());
+
+            this->levels.push_back(level);
+        }
+    }
+
+    // Drop the levels from k on, as when building them was interrupted
+    void truncate(int k) {
+        k = std::max(k, 1);
+
+        if (k < (int)this->levels.size()) {
+            this->levels.resize(k);
+            this->buffers.resize(k - 1);
+        }
+    }
+
+    int getNumLevels() const {
+        return (int)this->levels.size();
+    }
+
+    const PF_EffectWorld *getLevel(int k) const {
+        return &this->levels[k];
+    }
+
+    // Average 2x2 blocks of the level above into the rows [yStart, yEnd) of
+    // the level. Odd edges repeat their last row or column.
+    template <typename PixelType>
+    void downsampleRows(int k, A_long yStart, A_long yEnd) {
+        const PF_EffectWorld *aboveP = &this->levels[k - 1];
+        PF_EffectWorld *levelP = &this->levels[k];
+
+        for (A_long y = yStart; y < yEnd; y++) {
+            PixelType *dstP = reinterpret_cast<PixelType *>(
+                (char *)levelP->data + y * levelP->rowbytes);
+
+            for (A_long x = 0; x < levelP->width; x++) {
+                using PixelSampler::toFloat;
+                using PixelSampler::getPixel;
+
+                PF_PixelFloat a = toFloat(*getPixel<PixelType>(aboveP, 2 * x, 2 * y));
+                PF_PixelFloat b = toFloat(*getPixel<PixelType>(aboveP, 2 * x + 1, 2 * y));
+                PF_PixelFloat c = toFloat(*getPixel<PixelType>(aboveP, 2 * x, 2 * y + 1));
+                PF_PixelFloat d = toFloat(*getPixel<PixelType>(aboveP, 2 * x + 1, 2 * y + 1));
+
+                PF_PixelFloat mean = {(a.alpha + b.alpha + c.alpha + d.alpha) / 4,
+                                      (a.red + b.red + c.red + d.red) / 4,
+                                      (a.green + b.green + c.green + d.green) / 4,
+                                      (a.blue + b.blue + c.blue + d.blue) / 4};
+                PixelSampler::fromFloat(mean, &dstP[x]);
+            }
+        }
+    }
+
+    // Bilinear samples of the two levels around the level of detail, blended.
+    // The position is in pixels of level 0.
+    template <typename PixelType>
+    PF_PixelFloat sampleTrilinear(float x, float y, float lod) const {
+        lod = std::min(std::max(lod, 0.0f), (float)(this->levels.size() - 1));
+
+        int k = std::min((int)lod, (int)this->levels.size() - 2);
+        float t = lod - k;
+
+        if (k < 0) {
+            return PixelSampler::sampleBilinear<PixelType>(&this->levels[0], x, y);
+        }
+
+        PF_PixelFloat upper = this->sampleLevel<PixelType>(k, x, y);
+
+        if (t <= 0) {
+            return upper;
+        }
+
+        return PixelSampler::lerp(upper, this->sampleLevel<PixelType>(k + 1, x, y), t);
+    }
+
+    // Anisotropic sample of the footprint of an output pixel, the
+    // parallelogram spanned by the derivatives (ax, ay) and (bx, by) of the
+    // position along the output axes. The minor axis picks the level, and up
+    // to MIP_MAX_ANISOTROPY trilinear taps are spread along the major axis,
+    // much like the anisotropic filtering of GPUs.
+    template <typename PixelType>
+    PF_PixelFloat sampleAnisotropic(float x, float y, float ax, float ay,
+                                    float bx, float by) const {
+        int numTaps;
+        float lod, axisX, axisY;
+
+        if (!this->getFootprint(ax, ay, bx, by, &numTaps, &lod, &axisX, &axisY)) {
+            return PixelSampler::sampleBilinear<PixelType>(&this->levels[0], x, y);
+        }
+
+        if (numTaps <= 1) {
+            return this->sampleTrilinear<PixelType>(x, y, lod);
+        }
+
+        PF_PixelFloat sum = {0, 0, 0, 0};
+
+        for (int i = 0; i < numTaps; i++) {
+            float s = (i + 0.5f) / numTaps - 0.5f;
+            PF_PixelFloat p =
+                this->sampleTrilinear<PixelType>(x + axisX * s, y + axisY * s, lod);
+
+            sum.alpha += p.alpha;
+            sum.red += p.red;
+            sum.green += p.green;
+            sum.blue += p.blue;
+        }
+
+        return {sum.alpha / numTaps, sum.red / numTaps, sum.green / numTaps,
+                sum.blue / numTaps};
+    }
+
+    // The same in the depth of the levels, with fixed point weights between
+    // them and the taps summed as integers. Float pyramids are sampled in
+    // float as above.
+    template <typename PixelType>
+    PixelType sampleAnisotropicFixed(float x, float y, float ax, float ay,
+                                     float bx, float by) const {
+        int numTaps;
+        float lod, axisX, axisY;
+
+        if (!this->getFootprint(ax, ay, bx, by, &numTaps, &lod, &axisX, &axisY)) {
+            return PixelSampler::sampleBilinearFixed<PixelType>(&this->levels[0], x, y);
+        }
+
+        if (numTaps <= 1) {
+            return this->sampleTrilinearFixed<PixelType>(x, y, lod);
+        }
+
+        A_long sum[4] = {0, 0, 0, 0};
+
+        for (int i = 0; i < numTaps; i++) {
+            float s = (i + 0.5f) / numTaps - 0.5f;
+            PixelType p =
+                this->sampleTrilinearFixed<PixelType>(x + axisX * s, y + axisY * s, lod);
+
+            sum[0] += p.alpha;
+            sum[1] += p.red;
+            sum[2] += p.green;
+            sum[3] += p.blue;
+        }
+
+        PixelType result;
+        result.alpha = (sum[0] + numTaps / 2) / numTaps;
+        result.red = (sum[1] + numTaps / 2) / numTaps;
+        result.green = (sum[2] + numTaps / 2) / numTaps;
+        result.blue = (sum[3] + numTaps / 2) / numTaps;
+        return result;
+    }
+
+   private:
+    std::vector<PF_EffectWorld> levels;
+    std::vector<std::vector<char>> buffers;
+
+    // Taps along the major axis of a footprint, the axis itself and the level
+    // of detail they are taken at. False when the footprint is magnified, or
+    // close to it, and level 0 is sampled as is.
+    bool getFootprint(float ax, float ay, float bx, float by, int *numTaps,
+                      float *lod, float *axisX, float *axisY) const {
+        float lengthA = std::sqrt(ax * ax + ay * ay);
+        float lengthB = std::sqrt(bx * bx + by * by);
+
+        float major = std::max(lengthA, lengthB);
+        float minor = std::min(lengthA, lengthB);
+
+        if (major <= 1 || this->levels.size() <= 1) {
+            return false;
+        }
+
+        *numTaps = (int)std::min(std::ceil(major / std::max(minor, 1e-6f)),
+                                 (float)MIP_MAX_ANISOTROPY);
+        *lod = std::log2(std::max(major / *numTaps, 1.0f));
+        *axisX = lengthA >= lengthB ? ax : bx;
+        *axisY = lengthA >= lengthB ? ay : by;
+        return true;
+    }
+
+    // Trilinear sample in the depth of the levels
+    template <typename PixelType>
+    PixelType sampleTrilinearFixed(float x, float y, float lod) const {
+        lod = std::min(std::max(lod, 0.0f), (float)(this->levels.size() - 1));
+
+        int k = std::min((int)lod, (int)this->levels.size() - 2);
+        int f = (int)((lod - k) * FIXED_WEIGHT_ONE + 0.5f);
+
+        if (k < 0) {
+            return PixelSampler::sampleBilinearFixed<PixelType>(&this->levels[0], x, y);
+        }
+
+        PixelType upper = this->sampleLevelFixed<PixelType>(k, x, y);
+
+        if (f <= 0) {
+            return upper;
+        }
+
+        return PixelSampler::lerpPixelFixed(upper,
+                                            this->sampleLevelFixed<PixelType>(k + 1, x, y), f);
+    }
+
+    // Bilinear sample of a level, at the position in pixels of level 0
+    template <typename PixelType>
+    PF_PixelFloat sampleLevel(int k, float x, float y) const {
+        const PF_EffectWorld *levelP = &this->levels[k];
+        float scaleX = (float)levelP->width / this->levels[0].width;
+        float scaleY = (float)levelP->height / this->levels[0].height;
+        return PixelSampler::sampleBilinear<PixelType>(levelP, x * scaleX, y * scaleY);
+    }
+
+    // The same in the depth of the level
+    template <typename PixelType>
+    PixelType sampleLevelFixed(int k, float x, float y) const {
+        const PF_EffectWorld *levelP = &this->levels[k];
+        float scaleX = (float)levelP->width / this->levels[0].width;
+        float scaleY = (float)levelP->height / this->levels[0].height;
+        return PixelSampler::sampleBilinearFixed<PixelType>(levelP, x * scaleX,
+                                                            y * scaleY);
+    }
+};
+
+template <>
+inline PF_PixelFloat MipPyramid::sampleAnisotropicFixed<PF_PixelFloat>(
+    float x, float y, float ax, float ay, float bx, float by) const {
+    return this->sampleAnisotropic<PF_PixelFloat>(x, y, ax, ay, bx, by);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "AEUtils.hpp"
+#include "MipPyramid.hpp"
+
+#include <vector>
+
+// Memory budget for the levels of cached pyramids
+#define MIP_PYRAMID_CACHE_BUDGET (256 * 1024 * 1024)
+
+// Keeps the pyramids built for input layers, the CPU counterpart of
+// TextureCache. While only params change, the checked-out layer pixels stay
+// the same, so the levels built for them are reused, and only extended when
+// a warp minifies the layer further than before. Layers are told apart by
+// the same fingerprint as the texture cache, along with their pixel format.
+class MipPyramidCache {
+   public:
+    struct Key {
+        uint64_t fingerprint = 0;
+        A_long width = 0, height = 0;
+        A_long rowbytes = 0;
+        PF_PixelFormat format = PF_PixelFormat_INVALID;
+
+        bool operator==(const Key &k) const {
+            return fingerprint == k.fingerprint && width == k.width &&
+                   height == k.height && rowbytes == k.rowbytes && format == k.format;
+        }
+    };
+
+    MipPyramidCache(size_t budgetBytes = MIP_PYRAMID_CACHE_BUDGET)
+        : budgetBytes(budgetBytes) {}
+
+    ~MipPyramidCache() {
+        this->clear();
+    }
+
+    static size_t getPixelBytes(PF_PixelFormat format) {
+        switch (format) {
+            case PF_PixelFormat_ARGB64:
+                return sizeof(PF_Pixel16);
+            case PF_PixelFormat_ARGB128:
+                return sizeof(PF_PixelFloat);
+            default:  // case PF_PixelFormat_ARGB32:
+                return sizeof(PF_Pixel8);
+        }
+    }
+
+    static Key makeKey(const PF_LayerDef *layerDef, PF_PixelFormat format) {
+        Key key;
+        key.fingerprint =
+            AEUtils::getLayerFingerprint(layerDef, getPixelBytes(format));
+        key.width = layerDef->width;
+        key.height = layerDef->height;
+        key.rowbytes = layerDef->rowbytes;
+        key.format = format;
+        return key;
+    }
+
+    // Returns the pyramid kept for the layer pixels, pointed at the layer,
+    // or a new one with no levels below it. The caller extends and builds
+    // the levels it needs.
+    MipPyramid *getPyramid(const PF_LayerDef *layerDef, PF_PixelFormat format) {
+        Key key = makeKey(layerDef, format);
+
+        for (auto &entry : this->entries) {
+            if (entry.key == key) {
+                entry.lastUsed = ++this->clock;
+                entry.pyramid->setWorld(layerDef);
+                return entry.pyramid;
+            }
+        }
+
+        // Charged for as deep as the pyramid may go, so that extending it
+        // later never exceeds the budget
+        size_t bytes = getLevelsBytes(layerDef, getPixelBytes(format));
+        this->evict(bytes);
+
+        Entry entry;
+        entry.key = key;
+        entry.pyramid = new MipPyramid();
+        entry.pyramid->setWorld(layerDef);
+        entry.bytes = bytes;
+        entry.lastUsed = ++this->clock;
+
+        this->entries.push_back(entry);
+        this->usedBytes += bytes;
+
+        return entry.pyramid;
+    }
+
+    void clear() {
+        for (auto &entry : this->entries) {
+            delete entry.pyramid;
+        }
+        this->entries.clear();
+        this->usedBytes = 0;
+    }
+
+   private:
+    struct Entry {
+        Key key;
+        MipPyramid *pyramid = nullptr;
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    std::vector<Entry> entries;
+    size_t budgetBytes = 0, usedBytes = 0;
+    uint64_t clock = 0;
+
+    // Bytes of every level below the layer, down to MIP_MAX_LEVELS or 1x1
+    static size_t getLevelsBytes(const PF_LayerDef *layerDef, size_t pixelBytes) {
+        size_t bytes = 0;
+        A_long width = layerDef->width, height = layerDef->height;
+
+        for (int k = 1; k <= MIP_MAX_LEVELS && (width > 1 || height > 1); k++) {
+            width = std::max((width + 1) / 2, (A_long)1);
+            height = std::max((height + 1) / 2, (A_long)1);
+            bytes += (size_t)width * height * pixelBytes;
+        }
+
+        return bytes;
+    }
+
+    void evict(size_t incomingBytes) {
+        while (!this->entries.empty() &&
+               this->usedBytes + incomingBytes > this->budgetBytes) {
+            auto lru = this->entries.begin();
+            for (auto it = this->entries.begin(); it != this->entries.end(); it++) {
+                if (it->lastUsed < lru->lastUsed) {
+                    lru = it;
+                }
+            }
+
+            delete lru->pyramid;
+            this->usedBytes -= lru->bytes;
+            this->entries.erase(lru);
+        }
+    }
+};
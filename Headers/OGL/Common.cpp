@@ -12,12 +12,42 @@ GLint getInternalFormat(GLenum pixelType) {
             return GL_RGBA8;
         case GL_UNSIGNED_SHORT:
             return GL_RGBA16_EXT;
+        case GL_HALF_FLOAT:
+            return GL_RGBA16F;
         case GL_FLOAT:
             return GL_RGBA32F;
     }
     return 0;
 }
 
+GLint getInternalFormat(GLenum format, GLenum pixelType) {
+    switch (format) {
+        case GL_RED:
+            switch (pixelType) {
+                case GL_UNSIGNED_BYTE:
+                    return GL_R8;
+                case GL_HALF_FLOAT:
+                    return GL_R16F;
+                case GL_FLOAT:
+                    return GL_R32F;
+            }
+            break;
+        case GL_RG:
+            switch (pixelType) {
+                case GL_UNSIGNED_BYTE:
+                    return GL_RG8;
+                case GL_HALF_FLOAT:
+                    return GL_RG16F;
+                case GL_FLOAT:
+                    return GL_RG32F;
+            }
+            break;
+        default:
+            return getInternalFormat(pixelType);
+    }
+    return 0;
+}
+
 void assertOpenGLError(const std::string& msg) {
     GLenum error = glGetError();
 
@@ -7,6 +7,7 @@
 
 namespace OGL {
 GLint getInternalFormat(GLenum pixelType);
+GLint getInternalFormat(GLenum format, GLenum pixelType);
 
 void assertOpenGLError(const std::string& msg);
 }  // namespace OGL
@@ -32,6 +32,7 @@ void Fbo::allocate(GLsizei width, GLsizei height, GLenum format, GLenum pixelTyp
     glGetError();
 
     bool configChanged = this->width != width || this->height != height;
+    configChanged |= this->format != format;
     configChanged |= this->pixelType != pixelType;
     configChanged |= this->numSamples != numSamples;
 
@@ -56,17 +57,25 @@ void Fbo::allocate(GLsizei width, GLsizei height, GLenum format, GLenum pixelTyp
 
         // Attach render buffer to fbo
         GLenum rboFormat;
-        switch (pixelType) {
-            case GL_UNSIGNED_BYTE:
-                rboFormat = GL_RGBA8;
-                break;
-            case GL_UNSIGNED_SHORT:
-                // NOTE: Not yet supported
-                rboFormat = GL_RGB16_EXT;
-                break;
-            case GL_FLOAT:
-                rboFormat = GL_RGBA32F_EXT;
-                break;
+        if (format != GL_RGBA) {
+            // Single or two channel float fields
+            rboFormat = getInternalFormat(format, pixelType);
+        } else {
+            switch (pixelType) {
+                case GL_UNSIGNED_BYTE:
+                    rboFormat = GL_RGBA8;
+                    break;
+                case GL_UNSIGNED_SHORT:
+                    // NOTE: Not yet supported
+                    rboFormat = GL_RGB16_EXT;
+                    break;
+                case GL_HALF_FLOAT:
+                    rboFormat = GL_RGBA16F_EXT;
+                    break;
+                case GL_FLOAT:
+                    rboFormat = GL_RGBA32F_EXT;
+                    break;
+            }
         }
 
         glGenRenderbuffers(1, &this->rbo);
@@ -24,16 +24,19 @@ void Texture::allocate(GLsizei width, GLsizei height,
 
     if (this->ID == 0) {
         glGenTextures(1, &this->ID);
+        this->mipmapped = false;
 
         this->bind();
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, this->magFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, this->minFilter);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         assertOpenGLError("glTexParameteri");
 
-        glTexImage2D(GL_TEXTURE_2D, 0, format, this->width, this->height,
+        GLint internalFormat = format == GL_RGBA ? format
+                                                 : getInternalFormat(format, pixelType);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, this->width, this->height,
                      0, format, this->pixelType, nullptr);
         assertOpenGLError("glTexImage2D");
 
@@ -41,6 +44,41 @@ void Texture::allocate(GLsizei width, GLsizei height,
     }
 }
 
+void Texture::setFilter(GLenum filter) {
+    this->setFilter(filter, filter);
+}
+
+// The mipmapped min filters sample nothing until generateMipmaps is called
+void Texture::setFilter(GLenum minFilter, GLenum magFilter) {
+    if (this->minFilter == minFilter && this->magFilter == magFilter) {
+        return;
+    }
+    this->minFilter = minFilter;
+    this->magFilter = magFilter;
+
+    this->bind();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    assertOpenGLError("Texture::setFilter glTexParameteri");
+    this->unbind();
+}
+
+// Build the mip chain from level 0, once per texture. Pixels uploaded later
+// through glTexSubImage2D aren't reflected in it, so textures are expected
+// to be filled once, as the texture cache does.
+void Texture::generateMipmaps() {
+    if (this->mipmapped) {
+        return;
+    }
+
+    this->bind();
+    glGenerateMipmap(GL_TEXTURE_2D);
+    assertOpenGLError("glGenerateMipmap");
+    this->unbind();
+
+    this->mipmapped = true;
+}
+
 Texture::~Texture() {
     glDeleteTextures(1, &this->ID);
 }
@@ -8,6 +8,9 @@ class Texture {
     ~Texture();
 
     void allocate(GLsizei width, GLsizei height, GLenum format, GLenum pixelType);
+    void setFilter(GLenum filter);
+    void setFilter(GLenum minFilter, GLenum magFilter);
+    void generateMipmaps();
     void bind();
     void unbind();
     GLuint getID();
@@ -18,6 +21,9 @@ class Texture {
     GLsizei height = 0;
     GLenum format = 0;
     GLenum pixelType = 0;
+    GLenum minFilter = GL_LINEAR;
+    GLenum magFilter = GL_LINEAR;
+    bool mipmapped = false;
 };
 
 }  // namespace OGL
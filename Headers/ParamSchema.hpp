@@ -0,0 +1,215 @@
+#pragma once
+
+#include "AE_Effect.h"
+#include "AE_EffectCB.h"
+#include "AE_EffectCBSuites.h"
+#include "AE_Macros.h"
+#include "AEFX_SuiteHelper.h"
+
+#include <cstddef>
+
+#define PI 3.14159265358979323864f
+
+// Tables of the params an effect reads, and where each value goes in a plain
+// struct, so that all of them are checked out in a single pass. Point and
+// angle params are converted to the requested space on the way.
+//
+// A schema is a constant array of entries, built with the functions below:
+//
+//     static constexpr ParamSchema::Entry PARAM_SCHEMA[] = {
+//         ParamSchema::popup(PARAM_MODE, PARAM_FIELD(ParamInfo, mode)),
+//         ParamSchema::point(PARAM_CENTER, ParamSchema::AE_SPACE,
+//                            PARAM_FIELD(ParamInfo, center)),
+//     };
+//
+//     ERR(ParamSchema::checkout(in_data, out_data, PARAM_SCHEMA, paramInfo));
+namespace ParamSchema {
+
+enum { GL_SPACE = 1,
+       AE_SPACE };
+
+enum { KIND_POPUP = 1,
+       KIND_SLIDER,
+       KIND_FLOAT_SLIDER,
+       KIND_CHECKBOX,
+       KIND_POINT,
+       KIND_ANGLE };
+
+// Offset of a field in the struct the values are read into, tagged with the
+// type of the field so that each kind of param only takes fields it can fill
+template <typename T>
+struct Field {
+    size_t offset;
+};
+
+#define PARAM_FIELD(Params, field) \
+    ParamSchema::Field<decltype(Params::field)>{offsetof(Params, field)}
+
+// A run of count params with consecutive ids, read into consecutive values
+// from the offset on
+struct Entry {
+    A_long paramId;
+    int kind;
+    int space;
+    size_t offset;
+    A_long count;
+};
+
+constexpr Entry popup(A_long paramId, Field<A_long> field) {
+    return {paramId, KIND_POPUP, 0, field.offset, 1};
+}
+
+constexpr Entry slider(A_long paramId, Field<A_long> field) {
+    return {paramId, KIND_SLIDER, 0, field.offset, 1};
+}
+
+constexpr Entry floatSlider(A_long paramId, Field<PF_FpLong> field) {
+    return {paramId, KIND_FLOAT_SLIDER, 0, field.offset, 1};
+}
+
+constexpr Entry checkbox(A_long paramId, Field<PF_Boolean> field) {
+    return {paramId, KIND_CHECKBOX, 0, field.offset, 1};
+}
+
+constexpr Entry point(A_long paramId, int space, Field<A_FloatPoint> field) {
+    return {paramId, KIND_POINT, space, field.offset, 1};
+}
+
+constexpr Entry angle(A_long paramId, int space, Field<A_FpLong> field) {
+    return {paramId, KIND_ANGLE, space, field.offset, 1};
+}
+
+// The first count points of an array, from paramId on
+template <size_t N>
+constexpr Entry points(A_long paramId, int space, Field<A_FloatPoint[N]> field,
+                       A_long count = N) {
+    return {paramId, KIND_POINT, space, field.offset, count < (A_long)N ? count : (A_long)N};
+}
+
+// Point in layer pixels at the current downsampling, as the point suite
+// returns it, to the space
+inline void convertPoint(const PF_InData *in_data, int space, A_FloatPoint *value) {
+    float downsampleX = (float)in_data->downsample_x.num / in_data->downsample_x.den;
+    float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
+
+    if (space == GL_SPACE) {
+        // Scale size by downsample ratio
+        float width = (float)in_data->width * downsampleX;
+        float height = (float)in_data->height * downsampleY;
+
+        value->x /= width;
+        value->y = 1.0f - value->y / height;
+    } else {  // AE_SPACE
+        // Convert to actual size
+        value->x /= downsampleX;
+        value->y /= downsampleY;
+    }
+}
+
+// Angle in degrees to the space
+inline void convertAngle(int space, A_FpLong *value) {
+    if (space == GL_SPACE) {
+        *value = -*value * PI / 180.0f;
+    }
+}
+
+// Check out the params of the schema at the time into the struct, with the
+// time step in the same scale as the time. The point and angle suites are
+// acquired once for the whole pass, and only if the schema has params of
+// their kind.
+inline PF_Err checkout(PF_InData *in_data, PF_OutData *out_data,
+                       const Entry *schema, size_t numEntries, void *params,
+                       A_long time, A_long timeStep, A_u_long timeScale) {
+    PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
+
+    PF_PointParamSuite1 *pointSuite = nullptr;
+    PF_AngleParamSuite1 *angleSuite = nullptr;
+
+    for (size_t i = 0; !err && i < numEntries; i++) {
+        const Entry &entry = schema[i];
+        char *fieldP = reinterpret_cast<char *>(params) + entry.offset;
+
+        if (entry.kind == KIND_POINT && !pointSuite) {
+            ERR(AEFX_AcquireSuite(in_data, out_data, kPFPointParamSuite,
+                                  kPFPointParamSuiteVersion1,
+                                  "Couldn't load suite.", (void **)&pointSuite));
+        } else if (entry.kind == KIND_ANGLE && !angleSuite) {
+            ERR(AEFX_AcquireSuite(in_data, out_data, kPFAngleParamSuite,
+                                  kPFAngleParamSuiteVersion1,
+                                  "Couldn't load suite.", (void **)&angleSuite));
+        }
+
+        for (A_long j = 0; !err && j < entry.count; j++) {
+            PF_ParamDef param_def;
+            AEFX_CLR_STRUCT(param_def);
+            ERR(PF_CHECKOUT_PARAM(in_data, entry.paramId + j, time,
+                                  timeStep, timeScale, &param_def));
+
+            switch (entry.kind) {
+                case KIND_POPUP:
+                    reinterpret_cast<A_long *>(fieldP)[j] = param_def.u.pd.value;
+                    break;
+                case KIND_SLIDER:
+                    reinterpret_cast<A_long *>(fieldP)[j] = param_def.u.sd.value;
+                    break;
+                case KIND_FLOAT_SLIDER:
+                    reinterpret_cast<PF_FpLong *>(fieldP)[j] = param_def.u.fs_d.value;
+                    break;
+                case KIND_CHECKBOX:
+                    reinterpret_cast<PF_Boolean *>(fieldP)[j] = param_def.u.bd.value;
+                    break;
+                case KIND_POINT: {
+                    A_FloatPoint *value = reinterpret_cast<A_FloatPoint *>(fieldP) + j;
+                    ERR(pointSuite->PF_GetFloatingPointValueFromPointDef(
+                        in_data->effect_ref, &param_def, value));
+
+                    if (!err) {
+                        convertPoint(in_data, entry.space, value);
+                    }
+                    break;
+                }
+                case KIND_ANGLE: {
+                    A_FpLong *value = reinterpret_cast<A_FpLong *>(fieldP) + j;
+                    ERR(angleSuite->PF_GetFloatingPointValueFromAngleDef(
+                        in_data->effect_ref, &param_def, value));
+
+                    if (!err) {
+                        convertAngle(entry.space, value);
+                    }
+                    break;
+                }
+            }
+
+            ERR2(PF_CHECKIN_PARAM(in_data, &param_def));
+        }
+    }
+
+    if (pointSuite) {
+        ERR2(AEFX_ReleaseSuite(in_data, out_data, kPFPointParamSuite,
+                               kPFPointParamSuiteVersion1, "Couldn't release suite."));
+    }
+
+    if (angleSuite) {
+        ERR2(AEFX_ReleaseSuite(in_data, out_data, kPFAngleParamSuite,
+                               kPFAngleParamSuiteVersion1, "Couldn't release suite."));
+    }
+
+    return err;
+}
+
+template <size_t N>
+PF_Err checkout(PF_InData *in_data, PF_OutData *out_data,
+                const Entry (&schema)[N], void *params, A_long time,
+                A_long timeStep, A_u_long timeScale) {
+    return checkout(in_data, out_data, schema, N, params, time, timeStep, timeScale);
+}
+
+// At the current time
+template <size_t N>
+PF_Err checkout(PF_InData *in_data, PF_OutData *out_data,
+                const Entry (&schema)[N], void *params) {
+    return checkout(in_data, out_data, schema, N, params, in_data->current_time,
+                    in_data->time_step, in_data->time_scale);
+}
+
+}  // namespace ParamSchema
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "AE_Effect.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace PixelSampler {
+
+// Channel values as stored in each depth, widened to float for filtering.
+// Nothing is normalized, so that writing back to the same depth round-trips.
+inline PF_PixelFloat toFloat(const PF_Pixel8 &p) {
+    return {(PF_FpShort)p.alpha, (PF_FpShort)p.red, (PF_FpShort)p.green,
+            (PF_FpShort)p.blue};
+}
+
+inline PF_PixelFloat toFloat(const PF_Pixel16 &p) {
+    return {(PF_FpShort)p.alpha, (PF_FpShort)p.red, (PF_FpShort)p.green,
+            (PF_FpShort)p.blue};
+}
+
+inline PF_PixelFloat toFloat(const PF_PixelFloat &p) {
+    return p;
+}
+
+template <typename ChannelType>
+inline ChannelType toChannel(float v, float maxValue) {
+    return (ChannelType)(std::min(std::max(v, 0.0f), maxValue) + 0.5f);
+}
+
+inline void fromFloat(const PF_PixelFloat &p, PF_Pixel8 *out) {
+    out->alpha = toChannel<A_u_char>(p.alpha, PF_MAX_CHAN8);
+    out->red = toChannel<A_u_char>(p.red, PF_MAX_CHAN8);
+    out->green = toChannel<A_u_char>(p.green, PF_MAX_CHAN8);
+    out->blue = toChannel<A_u_char>(p.blue, PF_MAX_CHAN8);
+}
+
+inline void fromFloat(const PF_PixelFloat &p, PF_Pixel16 *out) {
+    out->alpha = toChannel<A_u_short>(p.alpha, PF_MAX_CHAN16);
+    out->red = toChannel<A_u_short>(p.red, PF_MAX_CHAN16);
+    out->green = toChannel<A_u_short>(p.green, PF_MAX_CHAN16);
+    out->blue = toChannel<A_u_short>(p.blue, PF_MAX_CHAN16);
+}
+
+inline void fromFloat(const PF_PixelFloat &p, PF_PixelFloat *out) {
+    *out = p;
+}
+
+inline PF_PixelFloat lerp(const PF_PixelFloat &a, const PF_PixelFloat &b,
+                          float t) {
+    return {a.alpha + (b.alpha - a.alpha) * t, a.red + (b.red - a.red) * t,
+            a.green + (b.green - a.green) * t, a.blue + (b.blue - a.blue) * t};
+}
+
+// Pixel at the index, clamped to the edges of the world like
+// GL_CLAMP_TO_EDGE
+template <typename PixelType>
+inline const PixelType *getPixel(const PF_EffectWorld *worldP, A_long x,
+                                 A_long y) {
+    x = std::min(std::max(x, (A_long)0), worldP->width - 1);
+    y = std::min(std::max(y, (A_long)0), worldP->height - 1);
+    return reinterpret_cast<const PixelType *>((const char *)worldP->data +
+                                               y * worldP->rowbytes) +
+           x;
+}
+
+// The samplers take coordinates in pixels with pixel centers at half-integers,
+// the same as texture coordinates multiplied by the size in OpenGL.
+
+template <typename PixelType>
+inline PF_PixelFloat sampleNearest(const PF_EffectWorld *worldP, float x,
+                                   float y) {
+    return toFloat(*getPixel<PixelType>(worldP, (A_long)std::floor(x),
+                                        (A_long)std::floor(y)));
+}
+
+// The same in the depth of the world
+template <typename PixelType>
+inline PixelType sampleNearestPixel(const PF_EffectWorld *worldP, float x,
+                                    float y) {
+    return *getPixel<PixelType>(worldP, (A_long)std::floor(x), (A_long)std::floor(y));
+}
+
+#ifdef __SSE2__
+// A pixel widened to the four lanes of a vector, in the same ARGB order
+inline __m128 toVector(const PF_Pixel8 &p) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128(*reinterpret_cast<const int *>(&p));
+    v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+    return _mm_cvtepi32_ps(v);
+}
+
+inline __m128 toVector(const PF_Pixel16 &p) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&p));
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+}
+
+inline __m128 toVector(const PF_PixelFloat &p) {
+    return _mm_loadu_ps(&p.alpha);
+}
+
+inline __m128 lerp(__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+#endif
+
+template <typename PixelType>
+inline PF_PixelFloat sampleBilinear(const PF_EffectWorld *worldP, float x,
+                                    float y) {
+    x -= 0.5f;
+    y -= 0.5f;
+
+    float x0 = std::floor(x), y0 = std::floor(y);
+    float tx = x - x0, ty = y - y0;
+    A_long ix = (A_long)x0, iy = (A_long)y0;
+
+#ifdef __SSE2__
+    // All four channels are filtered at once
+    __m128 vtx = _mm_set1_ps(tx);
+    __m128 top = lerp(toVector(*getPixel<PixelType>(worldP, ix, iy)),
+                      toVector(*getPixel<PixelType>(worldP, ix + 1, iy)), vtx);
+    __m128 bottom =
+        lerp(toVector(*getPixel<PixelType>(worldP, ix, iy + 1)),
+             toVector(*getPixel<PixelType>(worldP, ix + 1, iy + 1)), vtx);
+
+    PF_PixelFloat result;
+    _mm_storeu_ps(&result.alpha, lerp(top, bottom, _mm_set1_ps(ty)));
+    return result;
+#else
+    PF_PixelFloat top = lerp(toFloat(*getPixel<PixelType>(worldP, ix, iy)),
+                             toFloat(*getPixel<PixelType>(worldP, ix + 1, iy)),
+                             tx);
+    PF_PixelFloat bottom =
+        lerp(toFloat(*getPixel<PixelType>(worldP, ix, iy + 1)),
+             toFloat(*getPixel<PixelType>(worldP, ix + 1, iy + 1)), tx);
+
+    return lerp(top, bottom, ty);
+#endif
+}
+
+// Bilinear sampling in the depth of the world, without widening the taps to
+// float. Pixels are interpolated horizontally, then vertically, each time
+// with 14-bit fixed point weights: 8bpc channels are weighted in 16-bit lanes
+// and summed in 32 bits, and 16bpc ones are first offset by half their range
+// to fit signed 16-bit lanes. Float worlds are filtered in float as usual.
+#define FIXED_WEIGHT_BITS 14
+#define FIXED_WEIGHT_ONE (1 << FIXED_WEIGHT_BITS)
+
+struct FixedPosition {
+    A_long ix, iy;
+    int fx, fy;
+};
+
+inline FixedPosition getFixedPosition(float x, float y) {
+    x -= 0.5f;
+    y -= 0.5f;
+
+    float x0 = std::floor(x), y0 = std::floor(y);
+    return {(A_long)x0, (A_long)y0,
+            (int)((x - x0) * FIXED_WEIGHT_ONE + 0.5f),
+            (int)((y - y0) * FIXED_WEIGHT_ONE + 0.5f)};
+}
+
+// a + (b - a) * f in fixed point, rounded
+inline int lerpFixed(int a, int b, int f) {
+    return (a * (FIXED_WEIGHT_ONE - f) + b * f + FIXED_WEIGHT_ONE / 2) >>
+           FIXED_WEIGHT_BITS;
+}
+
+#ifdef __SSE2__
+// The same on the four channels at once, for 16-bit lanes holding the
+// channels in their low half, and the result in the same layout
+inline __m128i lerpFixed(__m128i a, __m128i b, int f) {
+    __m128i sum = _mm_madd_epi16(_mm_unpacklo_epi16(a, b),
+                                 _mm_set1_epi32((f << 16) | (FIXED_WEIGHT_ONE - f)));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(FIXED_WEIGHT_ONE / 2)),
+                         FIXED_WEIGHT_BITS);
+    return _mm_packs_epi32(sum, sum);
+}
+
+inline __m128i toLanes(const PF_Pixel8 &p) {
+    __m128i v = _mm_cvtsi32_si128(*reinterpret_cast<const int *>(&p));
+    return _mm_unpacklo_epi8(v, _mm_setzero_si128());
+}
+
+inline __m128i toLanes(const PF_Pixel16 &p) {
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&p));
+    return _mm_sub_epi16(v, _mm_set1_epi16(PF_MAX_CHAN16 / 2));
+}
+
+// Back from lanes, the offset of 16bpc channels removed
+inline void fromLanes(__m128i v, PF_Pixel8 *out) {
+    *reinterpret_cast<int *>(out) = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+}
+
+inline void fromLanes(__m128i v, PF_Pixel16 *out) {
+    v = _mm_add_epi16(v, _mm_set1_epi16(PF_MAX_CHAN16 / 2));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(out), v);
+}
+#endif
+
+template <typename PixelType>
+inline PixelType sampleBilinearFixed(const PF_EffectWorld *worldP, float x,
+                                     float y) {
+    FixedPosition p = getFixedPosition(x, y);
+    const PixelType &p00 = *getPixel<PixelType>(worldP, p.ix, p.iy);
+    const PixelType &p10 = *getPixel<PixelType>(worldP, p.ix + 1, p.iy);
+    const PixelType &p01 = *getPixel<PixelType>(worldP, p.ix, p.iy + 1);
+    const PixelType &p11 = *getPixel<PixelType>(worldP, p.ix + 1, p.iy + 1);
+
+    PixelType result;
+
+#ifdef __SSE2__
+    __m128i top = lerpFixed(toLanes(p00), toLanes(p10), p.fx);
+    __m128i bottom = lerpFixed(toLanes(p01), toLanes(p11), p.fx);
+    fromLanes(lerpFixed(top, bottom, p.fy), &result);
+#else
+    // At most PF_MAX_CHAN16 << FIXED_WEIGHT_BITS, well within 32 bits
+    result.alpha = lerpFixed(lerpFixed(p00.alpha, p10.alpha, p.fx),
+                             lerpFixed(p01.alpha, p11.alpha, p.fx), p.fy);
+    result.red = lerpFixed(lerpFixed(p00.red, p10.red, p.fx),
+                           lerpFixed(p01.red, p11.red, p.fx), p.fy);
+    result.green = lerpFixed(lerpFixed(p00.green, p10.green, p.fx),
+                             lerpFixed(p01.green, p11.green, p.fx), p.fy);
+    result.blue = lerpFixed(lerpFixed(p00.blue, p10.blue, p.fx),
+                            lerpFixed(p01.blue, p11.blue, p.fx), p.fy);
+#endif
+
+    return result;
+}
+
+// Interpolate two pixels in their depth, with a fixed point weight
+template <typename PixelType>
+inline PixelType lerpPixelFixed(const PixelType &a, const PixelType &b, int f) {
+    PixelType result;
+
+#ifdef __SSE2__
+    fromLanes(lerpFixed(toLanes(a), toLanes(b), f), &result);
+#else
+    result.alpha = lerpFixed(a.alpha, b.alpha, f);
+    result.red = lerpFixed(a.red, b.red, f);
+    result.green = lerpFixed(a.green, b.green, f);
+    result.blue = lerpFixed(a.blue, b.blue, f);
+#endif
+
+    return result;
+}
+
+// Scale a premultiplied pixel by a coverage in [0, 1], in its depth
+template <typename PixelType>
+inline PixelType scalePixel(const PixelType &p, float coverage) {
+    PixelType transparent = {0, 0, 0, 0};
+    return lerpPixelFixed(transparent, p, (int)(coverage * FIXED_WEIGHT_ONE + 0.5f));
+}
+
+template <>
+inline PF_PixelFloat scalePixel<PF_PixelFloat>(const PF_PixelFloat &p,
+                                               float coverage) {
+    return {p.alpha * coverage, p.red * coverage, p.green * coverage,
+            p.blue * coverage};
+}
+
+template <>
+inline PF_PixelFloat lerpPixelFixed<PF_PixelFloat>(const PF_PixelFloat &a,
+                                                   const PF_PixelFloat &b, int f) {
+    return lerp(a, b, (float)f / FIXED_WEIGHT_ONE);
+}
+
+template <>
+inline PF_PixelFloat sampleBilinearFixed<PF_PixelFloat>(
+    const PF_EffectWorld *worldP, float x, float y) {
+    return sampleBilinear<PF_PixelFloat>(worldP, x, y);
+}
+
+}  // namespace PixelSampler
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+// Slots of each pool, one bit of its mask apiece
+#define PRE_RENDER_POOL_SIZE 64
+
+// Fixed pool of the data an effect hands from PreRender to SmartRender, one
+// pool per type of data. PreRender takes a slot with acquire, and release is
+// set as the delete_pre_render_data_func for AE to give it back once the
+// render is done. Slots are claimed and freed through an atomic mask, since
+// frames are pre-rendered on several threads at once.
+//
+// AE calls PreRender far more often than it renders, so the slots are
+// reused, rather than allocating a handle every time. When more data is in
+// flight than the pool holds, the rest falls back to the heap, so the size
+// only bounds the steady state.
+//
+// Slots are handed out as they were left, and PreRender has to assign every
+// field it reads later.
+template <typename T>
+class PreRenderPool {
+   public:
+    // Returns nullptr when out of memory
+    static T *acquire() {
+        PreRenderPool &pool = instance();
+        uint64_t used = pool.used.load(std::memory_order_relaxed);
+
+        while (~used) {
+            int k = 0;
+
+            while (used & ((uint64_t)1 << k)) {
+                k++;
+            }
+
+            if (pool.used.compare_exchange_weak(used, used | ((uint64_t)1 << k),
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+                return &pool.slots[k];
+            }
+        }
+
+        return new (std::nothrow) T;
+    }
+
+    // Matches PF_DeletePreRenderDataFunc
+    static void release(void *dataP) {
+        PreRenderPool &pool = instance();
+        T *slotP = static_cast<T *>(dataP);
+
+        if (slotP >= pool.slots && slotP < pool.slots + PRE_RENDER_POOL_SIZE) {
+            uint64_t bit = (uint64_t)1 << (slotP - pool.slots);
+            pool.used.fetch_and(~bit, std::memory_order_release);
+        } else {
+            delete slotP;
+        }
+    }
+
+   private:
+    static_assert(PRE_RENDER_POOL_SIZE > 0 && PRE_RENDER_POOL_SIZE <= 64,
+                  "The mask holds 64 slots at most");
+
+    // Bits past the slots start out set, so that they are never handed out
+    std::atomic<uint64_t> used{~(~(uint64_t)0 >> (64 - PRE_RENDER_POOL_SIZE))};
+    T slots[PRE_RENDER_POOL_SIZE];
+
+    static PreRenderPool &instance() {
+        static PreRenderPool pool;
+        return pool;
+    }
+};
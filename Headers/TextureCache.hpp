@@ -0,0 +1,171 @@
+#pragma once
+
+#include "AEOGLInterop.hpp"
+#include "AEUtils.hpp"
+#include "OGL.h"
+
+#include <vector>
+
+// VRAM budget for resident input textures
+#define TEXTURE_CACHE_BUDGET (512 * 1024 * 1024)
+
+namespace AEOGLInterop {
+
+// Keeps uploaded input layers resident on the GPU. While only params change,
+// the checked-out layer pixels stay the same, so the staging copy and
+// glTexSubImage2D can be skipped and the cached texture reused as is.
+class TextureCache {
+   public:
+    struct Key {
+        uint64_t fingerprint = 0;
+        GLsizei width = 0, height = 0;
+        A_long rowbytes = 0;
+        GLenum format = 0, pixelType = 0;
+
+        // Distinguishes textures derived from the same layer pixels
+        A_long variant = 0;
+
+        bool operator==(const Key &k) const {
+            return fingerprint == k.fingerprint && width == k.width &&
+                   height == k.height && rowbytes == k.rowbytes &&
+                   format == k.format && pixelType == k.pixelType &&
+                   variant == k.variant;
+        }
+    };
+
+    TextureCache(size_t budgetBytes = TEXTURE_CACHE_BUDGET)
+        : budgetBytes(budgetBytes) {}
+
+    ~TextureCache() {
+        this->clear();
+    }
+
+    static Key makeKey(PF_LayerDef *layerDef, GLenum format, GLenum pixelType,
+                       A_long variant = 0) {
+        Key key;
+        key.fingerprint = AEUtils::getLayerFingerprint(layerDef,
+                                                       getPixelBytes(pixelType));
+        key.width = layerDef->width;
+        key.height = layerDef->height;
+        key.rowbytes = layerDef->rowbytes;
+        key.format = format;
+        key.pixelType = pixelType;
+        key.variant = variant;
+        return key;
+    }
+
+    // Returns the resident texture for the key, or nullptr
+    OGL::Texture *find(const Key &key) {
+        for (auto &entry : this->entries) {
+            if (entry.key == key) {
+                entry.lastUsed = ++this->clock;
+                return entry.texture;
+            }
+        }
+        return nullptr;
+    }
+
+    // Allocates a texture for the key, evicting least recently used ones
+    // to stay within the budget. The caller uploads the pixels.
+    OGL::Texture *insert(const Key &key, size_t bytes) {
+        this->evict(bytes);
+
+        Entry entry;
+        entry.key = key;
+        entry.texture = new OGL::Texture();
+        entry.texture->allocate(key.width, key.height, key.format, key.pixelType);
+        entry.bytes = bytes;
+        entry.lastUsed = ++this->clock;
+
+        this->entries.push_back(entry);
+        this->usedBytes += bytes;
+
+        return entry.texture;
+    }
+
+    // Returns a texture holding the layer pixels, uploading them through
+    // pixelsBufferP only when no resident texture matches
+    OGL::Texture *getTexture(PF_LayerDef *layerDef, void *pixelsBufferP,
+                             GLenum pixelType) {
+        Key key = makeKey(layerDef, GL_RGBA, pixelType);
+        return this->getTexture(key, layerDef, pixelsBufferP, pixelType);
+    }
+
+    // Same as above, for callers that already fingerprinted the layer
+    OGL::Texture *getTexture(const Key &key, PF_LayerDef *layerDef,
+                             void *pixelsBufferP, GLenum pixelType) {
+        OGL::Texture *texture = this->find(key);
+
+        if (!texture) {
+            size_t bytes = key.width * key.height * getPixelBytes(pixelType);
+            texture = this->insert(key, bytes);
+            uploadTexture(texture, layerDef, pixelsBufferP, pixelType);
+        }
+
+        return texture;
+    }
+
+    // Builds the mip chain of a resident texture once, charging the extra
+    // third of the base level against the budget
+    void generateMipmaps(OGL::Texture *texture) {
+        for (auto &entry : this->entries) {
+            if (entry.texture != texture) {
+                continue;
+            }
+            if (!entry.mipmapped) {
+                size_t extraBytes = entry.bytes / 3;
+                this->evict(extraBytes, texture);
+
+                texture->generateMipmaps();
+                entry.mipmapped = true;
+                entry.bytes += extraBytes;
+                this->usedBytes += extraBytes;
+            }
+            return;
+        }
+    }
+
+    void clear() {
+        for (auto &entry : this->entries) {
+            delete entry.texture;
+        }
+        this->entries.clear();
+        this->usedBytes = 0;
+    }
+
+   private:
+    struct Entry {
+        Key key;
+        OGL::Texture *texture = nullptr;
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+        bool mipmapped = false;
+    };
+
+    std::vector<Entry> entries;
+    size_t budgetBytes = 0, usedBytes = 0;
+    uint64_t clock = 0;
+
+    // Frees least recently used textures other than keep until incomingBytes
+    // more fit within the budget, or nothing else is left
+    void evict(size_t incomingBytes, const OGL::Texture *keep = nullptr) {
+        while (this->usedBytes + incomingBytes > this->budgetBytes) {
+            auto lru = this->entries.end();
+            for (auto it = this->entries.begin(); it != this->entries.end(); it++) {
+                if (it->texture != keep &&
+                    (lru == this->entries.end() || it->lastUsed < lru->lastUsed)) {
+                    lru = it;
+                }
+            }
+            if (lru == this->entries.end()) {
+                break;
+            }
+
+            delete lru->texture;
+            this->usedBytes -= lru->bytes;
+            this->entries.erase(lru);
+        }
+    }
+};
+
+}  // namespace AEOGLInterop
@@ -0,0 +1,292 @@
+// Homography against OpenCV.
+//
+// Solves the same triangles and quads with Homography::affine and
+// Homography::perspective and with cv::getAffineTransform and
+// cv::getPerspectiveTransform, and checks that both map points alike, on
+// random shapes and on the usual special cases. OpenCV takes points in single
+// precision, so every point is rounded to float first and both sides solve
+// the very same shape.
+//
+// Degenerate shapes, with coincident or collinear corners, have no transform.
+// Homography has to reject them, where OpenCV returns a singular matrix.
+//
+// OpenCV is only needed here, not by any of the effects.
+//
+//     make -C Headers/tests run
+
+#include "../Homography.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// Largest distance accepted between the points both transforms map to,
+// relative to the extent of the destination shape
+#define MAX_RELATIVE_ERROR 1e-6
+
+// Points across the source shape mapped by both, per side
+#define GRID_SIZE 5
+
+// Largest determinant, relative to the cube of the largest entry, for a
+// matrix of OpenCV to count as singular
+#define MAX_SINGULAR_DETERMINANT 1e-9
+
+#define NUM_RANDOM_CASES 10000
+
+static int numFailures = 0;
+
+static Homography::Point toPoint(const cv::Point2f &p) {
+    return {p.x, p.y};
+}
+
+static Homography::Matrix toMatrix(const cv::Mat &mat) {
+    Homography::Matrix result = Homography::identity();
+
+    for (int i = 0; i < mat.rows; i++) {
+        for (int j = 0; j < 3; j++) {
+            result.m[i][j] = mat.at<double>(i, j);
+        }
+    }
+
+    return result;
+}
+
+static double maxAbs(const Homography::Matrix &a) {
+    double result = 0;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            result = std::max(result, std::fabs(a.m[i][j]));
+        }
+    }
+
+    return result;
+}
+
+static void printPoints(const cv::Point2f *points, int n) {
+    for (int i = 0; i < n; i++) {
+        std::printf(" (%g, %g)", points[i].x, points[i].y);
+    }
+    std::printf("\n");
+}
+
+static void fail(const char *name, const cv::Point2f *src, const cv::Point2f *dst,
+                 int n, const char *reason) {
+    numFailures++;
+    std::printf("FAIL %s: %s\n  src", name, reason);
+    printPoints(src, n);
+    std::printf("  dst");
+    printPoints(dst, n);
+}
+
+// Largest extent of the points along either axis
+static double extent(const cv::Point2f *points, int n) {
+    cv::Point2f lo = points[0], hi = points[0];
+
+    for (int i = 1; i < n; i++) {
+        lo = cv::Point2f(std::min(lo.x, points[i].x), std::min(lo.y, points[i].y));
+        hi = cv::Point2f(std::max(hi.x, points[i].x), std::max(hi.y, points[i].y));
+    }
+
+    return std::max(hi.x - lo.x, hi.y - lo.y);
+}
+
+// The matrices are compared through the points they map, rather than entry
+// by entry, since a transform close to the horizon has large entries that
+// both solvers only get to within their rounding. Points are spread across
+// the source shape, by its corners for a triangle and bilinearly for a quad.
+static void compare(const char *name, const cv::Point2f *src, const cv::Point2f *dst,
+                    int n, bool solved, const Homography::Matrix &result,
+                    const Homography::Matrix &expected) {
+    if (!solved) {
+        fail(name, src, dst, n, "rejected");
+        return;
+    }
+
+    double error = 0;
+
+    for (int i = 0; i < GRID_SIZE; i++) {
+        for (int j = 0; j < GRID_SIZE; j++) {
+            double u = (double)i / (GRID_SIZE - 1), v = (double)j / (GRID_SIZE - 1);
+            Homography::Point p;
+
+            if (n == 3) {
+                if (u + v > 1) {
+                    continue;
+                }
+                p = {src[0].x + (src[1].x - src[0].x) * u + (src[2].x - src[0].x) * v,
+                     src[0].y + (src[1].y - src[0].y) * u + (src[2].y - src[0].y) * v};
+            } else {
+                p = {(src[0].x * (1 - u) + src[1].x * u) * (1 - v) +
+                         (src[3].x * (1 - u) + src[2].x * u) * v,
+                     (src[0].y * (1 - u) + src[1].y * u) * (1 - v) +
+                         (src[3].y * (1 - u) + src[2].y * u) * v};
+            }
+
+            // Points on the horizon of a self-intersecting quad map nowhere
+            if (std::fabs(Homography::weight(result, p)) <
+                MAX_RELATIVE_ERROR * maxAbs(result) * extent(src, n)) {
+                continue;
+            }
+
+            Homography::Point a = Homography::apply(result, p);
+            Homography::Point b = Homography::apply(expected, p);
+            error = std::max(error, std::hypot(a.x - b.x, a.y - b.y));
+        }
+    }
+
+    if (!(error <= MAX_RELATIVE_ERROR * std::max(extent(dst, n), 1.0))) {
+        char reason[64];
+        std::snprintf(reason, sizeof(reason), "maps %g px apart", error);
+        fail(name, src, dst, n, reason);
+    }
+}
+
+static void rejects(const char *name, const cv::Point2f *src, const cv::Point2f *dst,
+                    int n, bool solved, const Homography::Matrix &expected) {
+    if (solved) {
+        fail(name, src, dst, n, "solved");
+    }
+
+    // OpenCV has to agree that there is no transform
+    double scale = maxAbs(expected);
+    if (std::fabs(Homography::determinant(expected)) >
+        MAX_SINGULAR_DETERMINANT * scale * scale * scale) {
+        fail(name, src, dst, n, "not singular in OpenCV");
+    }
+}
+
+static void checkAffine(const char *name, const cv::Point2f src[3],
+                        const cv::Point2f dst[3], bool degenerate) {
+    Homography::Point s[3], d[3];
+    for (int i = 0; i < 3; i++) {
+        s[i] = toPoint(src[i]);
+        d[i] = toPoint(dst[i]);
+    }
+
+    Homography::Matrix result = Homography::identity();
+    bool solved = Homography::affine(s, d, &result);
+    Homography::Matrix expected = toMatrix(cv::getAffineTransform(src, dst));
+
+    if (degenerate) {
+        rejects(name, src, dst, 3, solved, expected);
+    } else {
+        compare(name, src, dst, 3, solved, result, expected);
+    }
+}
+
+static void checkPerspective(const char *name, const cv::Point2f src[4],
+                             const cv::Point2f dst[4], bool degenerate) {
+    Homography::Point s[4], d[4];
+    for (int i = 0; i < 4; i++) {
+        s[i] = toPoint(src[i]);
+        d[i] = toPoint(dst[i]);
+    }
+
+    Homography::Matrix result = Homography::identity();
+    bool solved = Homography::perspective(s, d, &result);
+    Homography::Matrix expected = toMatrix(cv::getPerspectiveTransform(src, dst));
+
+    if (degenerate) {
+        rejects(name, src, dst, 4, solved, expected);
+    } else {
+        compare(name, src, dst, 4, solved, result, expected);
+    }
+}
+
+// Corners of a rectangle of layer size, each moved by up to a third of it,
+// so that quads are convex or close to it, as pins are set
+static void randomQuad(std::mt19937 *rng, cv::Point2f quad[4]) {
+    std::uniform_real_distribution<float> size(16, 2048), jitter(-1 / 3.0f, 1 / 3.0f);
+    float w = size(*rng), h = size(*rng);
+    const float corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+    for (int i = 0; i < 4; i++) {
+        quad[i] = cv::Point2f((corners[i][0] + jitter(*rng)) * w,
+                              (corners[i][1] + jitter(*rng)) * h);
+    }
+}
+
+int main() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-1024, 3072);
+
+    // Triangles
+    {
+        cv::Point2f unit[3] = {{0, 0}, {1, 0}, {0, 1}};
+        cv::Point2f moved[3] = {{10, 20}, {11, 20}, {10, 21}};
+        cv::Point2f mirrored[3] = {{0, 0}, {0, 1}, {1, 0}};
+        cv::Point2f large[3] = {{-4096, -4096}, {8192, 0}, {0, 8192}};
+        cv::Point2f thin[3] = {{0, 0}, {1000, 1}, {2000, 3}};
+        checkAffine("affine identity", unit, unit, false);
+        checkAffine("affine translation", unit, moved, false);
+        checkAffine("affine mirror", unit, mirrored, false);
+        checkAffine("affine large", unit, large, false);
+        checkAffine("affine thin", unit, thin, false);
+        checkAffine("affine thin source", thin, unit, false);
+
+        cv::Point2f collinear[3] = {{0, 0}, {1, 1}, {2, 2}};
+        cv::Point2f coincident[3] = {{5, 5}, {5, 5}, {0, 1}};
+        cv::Point2f point[3] = {{3, 4}, {3, 4}, {3, 4}};
+        checkAffine("affine collinear", collinear, unit, true);
+        checkAffine("affine coincident", coincident, unit, true);
+        checkAffine("affine single point", point, unit, true);
+
+        for (int k = 0; k < NUM_RANDOM_CASES; k++) {
+            cv::Point2f src[3], dst[3];
+            for (int i = 0; i < 3; i++) {
+                src[i] = cv::Point2f(coord(rng), coord(rng));
+                dst[i] = cv::Point2f(coord(rng), coord(rng));
+            }
+            checkAffine("affine random", src, dst, false);
+        }
+    }
+
+    // Quads
+    {
+        cv::Point2f square[4] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+        cv::Point2f layer[4] = {{0, 0}, {1920, 0}, {1920, 1080}, {0, 1080}};
+        cv::Point2f parallelogram[4] = {{100, 100}, {500, 150}, {600, 450}, {200, 400}};
+        cv::Point2f trapezoid[4] = {{400, 0}, {600, 0}, {1000, 500}, {0, 500}};
+        cv::Point2f rotated[4] = {{1, 0}, {1, 1}, {0, 1}, {0, 0}};
+        cv::Point2f bowtie[4] = {{0, 0}, {1, 1}, {1, 0}, {0, 1}};
+        checkPerspective("perspective identity", square, square, false);
+        checkPerspective("perspective scale", square, layer, false);
+        checkPerspective("perspective parallelogram", layer, parallelogram, false);
+        checkPerspective("perspective trapezoid", layer, trapezoid, false);
+        checkPerspective("perspective trapezoid source", trapezoid, layer, false);
+        checkPerspective("perspective rotated order", layer, rotated, false);
+        checkPerspective("perspective self-intersecting", layer, bowtie, false);
+
+        cv::Point2f threeCollinear[4] = {{0, 0}, {1, 0}, {2, 0}, {0, 1}};
+        cv::Point2f allCollinear[4] = {{0, 0}, {1, 1}, {2, 2}, {3, 3}};
+        cv::Point2f coincident[4] = {{0, 0}, {1, 0}, {1, 1}, {1, 1}};
+        cv::Point2f point[4] = {{7, 7}, {7, 7}, {7, 7}, {7, 7}};
+        checkPerspective("perspective three collinear", threeCollinear, square, true);
+        checkPerspective("perspective all collinear", allCollinear, square, true);
+        checkPerspective("perspective coincident", coincident, square, true);
+        checkPerspective("perspective single point", point, square, true);
+        checkPerspective("perspective collinear destination", square, threeCollinear,
+                         true);
+        checkPerspective("perspective coincident destination", square, coincident,
+                         true);
+
+        for (int k = 0; k < NUM_RANDOM_CASES; k++) {
+            cv::Point2f src[4], dst[4];
+            randomQuad(&rng, src);
+            randomQuad(&rng, dst);
+            checkPerspective("perspective random", src, dst, false);
+        }
+    }
+
+    if (numFailures) {
+        std::printf("%d failed\n", numFailures);
+        return 1;
+    }
+
+    std::printf("All passed\n");
+    return 0;
+}
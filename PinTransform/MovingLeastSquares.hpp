@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Homography.hpp"
+
+#include <cmath>
+
+namespace MovingLeastSquares {
+
+// Affine moving least squares deformation, after Schaefer et al. "Image
+// Deformation Using Moving Least Squares".
+//
+// Each point moves by the affine transform that best fits the handles,
+// weighted by the inverse squared distance to each of them. The warp is
+// smooth, passes through the handles exactly, and reduces to the affine
+// transform of the handles wherever they agree on one.
+//
+// Points map from the positions p of the n handles to their positions q.
+// Warping by inverse mapping thus takes the destination pins as p and the
+// source pins as q.
+inline Homography::Point apply(const Homography::Point *p,
+                               const Homography::Point *q, int n,
+                               const Homography::Point &v) {
+    // Weighted centroids
+    double sumW = 0;
+    Homography::Point pStar = {0, 0}, qStar = {0, 0};
+
+    for (int i = 0; i < n; i++) {
+        double dx = p[i].x - v.x, dy = p[i].y - v.y;
+        double d2 = dx * dx + dy * dy;
+
+        // On a handle, where its weight is infinite
+        if (d2 < 1e-12) {
+            return q[i];
+        }
+
+        double w = 1 / d2;
+        sumW += w;
+        pStar.x += w * p[i].x;
+        pStar.y += w * p[i].y;
+        qStar.x += w * q[i].x;
+        qStar.y += w * q[i].y;
+    }
+
+    pStar.x /= sumW;
+    pStar.y /= sumW;
+    qStar.x /= sumW;
+    qStar.y /= sumW;
+
+    // Normal equations of the weighted fit of the centered handles
+    double a = 0, b = 0, c = 0;
+    double m00 = 0, m01 = 0, m10 = 0, m11 = 0;
+
+    for (int i = 0; i < n; i++) {
+        double dx = p[i].x - v.x, dy = p[i].y - v.y;
+        double w = 1 / (dx * dx + dy * dy);
+
+        double px = p[i].x - pStar.x, py = p[i].y - pStar.y;
+        double qx = q[i].x - qStar.x, qy = q[i].y - qStar.y;
+
+        a += w * px * px;
+        b += w * px * py;
+        c += w * py * py;
+        m00 += w * px * qx;
+        m01 += w * px * qy;
+        m10 += w * py * qx;
+        m11 += w * py * qy;
+    }
+
+    double vx = v.x - pStar.x, vy = v.y - pStar.y;
+    double det = a * c - b * b;
+
+    // Collinear handles fit no affine transform, and only translate
+    if (!(det > 1e-9 * a * c)) {
+        return {vx + qStar.x, vy + qStar.y};
+    }
+
+    // (v - p*) A^-1 B + q*, with A = [a b; b c] and B = [m00 m01; m10 m11]
+    double rx = (vx * c - vy * b) / det;
+    double ry = (vy * a - vx * b) / det;
+
+    return {rx * m00 + ry * m10 + qStar.x, rx * m01 + ry * m11 + qStar.y};
+}
+
+}  // namespace MovingLeastSquares
@@ -2,18 +2,16 @@
 
 #include "AEOGLInterop.hpp"
 #include "AEUtils.hpp"
+#include "Homography.hpp"
 
 #include "../Debug.h"
 #include "Settings.h"
 
 #include <glm/gtc/type_ptr.hpp>
-#include <glm/gtx/matrix_transform_2d.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include <opencv2/core.hpp>
-#include <opencv2/imgproc.hpp>
-
 #include <sstream>
+#include <vector>
 
 static PF_Err About(PF_InData *in_data, PF_OutData *out_data,
                     PF_ParamDef *params[], PF_LayerDef *output) {
@@ -33,13 +31,14 @@ static PF_Err GlobalSetup(PF_InData *in_data, PF_OutData *out_data,
     out_data->my_version = PF_VERSION(MAJOR_VERSION, MINOR_VERSION, BUG_VERSION,
                                       STAGE_VERSION, BUILD_VERSION);
 
-    // Enable 16bpc
-    out_data->out_flags =
-        PF_OutFlag_DEEP_COLOR_AWARE | PF_OutFlag_SEND_UPDATE_PARAMS_UI;
+    // Enable 16bpc, and reading pins at other times for motion blur
+    out_data->out_flags = PF_OutFlag_DEEP_COLOR_AWARE |
+                          PF_OutFlag_SEND_UPDATE_PARAMS_UI | PF_OutFlag_WIDE_TIME_INPUT;
 
-    // Enable 32bpc and SmartFX
-    out_data->out_flags2 =
-        PF_OutFlag2_FLOAT_COLOR_AWARE | PF_OutFlag2_SUPPORTS_SMART_RENDER;
+    // Enable 32bpc and SmartFX, and let AE track the times pins are read at
+    out_data->out_flags2 = PF_OutFlag2_FLOAT_COLOR_AWARE |
+                           PF_OutFlag2_SUPPORTS_SMART_RENDER |
+                           PF_OutFlag2_AUTOMATIC_WIDE_TIME_INPUT;
 
     // Initialize globalData
     auto handleSuite = suites.HandleSuite1();
@@ -54,16 +53,21 @@ static PF_Err GlobalSetup(PF_InData *in_data, PF_OutData *out_data,
     GlobalData *globalData = reinterpret_cast<GlobalData *>(
         handleSuite->host_lock_handle(globalDataH));
 
-    // Initialize global OpenGL context
+    // Pyramids of the input for the CPU path, kept across renders
+    new (&globalData->pyramidCache) MipPyramidCache();
+
+    // Initialize global OpenGL context. Without one, frames are warped on
+    // the CPU only.
     globalData->globalContext = *new OGL::GlobalContext();
     if (!globalData->globalContext.initialized) {
-        err = PF_Err_OUT_OF_MEMORY;
+        handleSuite->host_unlock_handle(globalDataH);
+        return err;
     }
 
     globalData->globalContext.bind();
 
     // Setup GL objects
-    globalData->inputTexture = *new OGL::Texture();
+    new (&globalData->inputTextureCache) AEOGLInterop::TextureCache();
     globalData->fbo = *new OGL::Fbo();
     globalData->quad = *new OGL::QuadVao();
 
@@ -86,44 +90,81 @@ static PF_Err ParamsSetup(PF_InData *in_data, PF_OutData *out_data,
 
     AEFX_CLR_STRUCT(def);
     def.flags |= PF_ParamFlag_SUPERVISE;
-    PF_ADD_POPUP("Editing Mode", 3, 3, "Source|Destination|Both", PARAM_EDITING_MODE);
+    PF_ADD_POPUP("Editing Mode", 3, 3, "Source|Destination|Both", DISK_ID_EDITING_MODE);
 
     AEFX_CLR_STRUCT(def);
     def.flags |= PF_ParamFlag_SUPERVISE;
-    PF_ADD_POPUP("Pin Type", 4, 4,
+    PF_ADD_POPUP("Pin Type", PIN_MAX_COUNT, 4,
                  "1 Pin  (Translate)|"
                  "2 Pins (Pos/Scale/Rot)|"
                  "3 Pins (Pos/Scale/Rot/Skew)|"
-                 "4 Pins (Perspective)",
-                 PARAM_PINCOUNT);
-
-    int pointDefaults[4][2]{{0, 0}, {100, 0}, {0, 100}, {100, 100}};
-
-    for (int i = 0; i < 4; i++) {
+                 "4 Pins (Perspective)|"
+                 "5 Pins (Mesh)|"
+                 "6 Pins (Mesh)|"
+                 "7 Pins (Mesh)|"
+                 "8 Pins (Mesh)",
+                 DISK_ID_PINCOUNT);
+
+    // Corners first, then the middles of the edges
+    int pointDefaults[PIN_MAX_COUNT][2]{{0, 0},  {100, 0},  {0, 100},  {100, 100},
+                                        {50, 0}, {0, 50}, {100, 50}, {50, 100}};
+
+    for (int i = 0; i < PIN_MAX_COUNT; i++) {
         std::ostringstream label;
         label << "Source Point " << (i + 1);
         AEFX_CLR_STRUCT(def);
         int x = pointDefaults[i][0];
         int y = pointDefaults[i][1];
-        PF_ADD_POINT(label.str().c_str(), x, y, false, PARAM_SRC_1 + i);
+        PF_ADD_POINT(label.str().c_str(), x, y, false,
+                     i < 4 ? DISK_ID_SRC_1 + i : DISK_ID_SRC_5 + i - 4);
     }
 
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < PIN_MAX_COUNT; i++) {
         std::ostringstream label;
         label << "Destination Point " << (i + 1);
         AEFX_CLR_STRUCT(def);
         int x = pointDefaults[i][0];
         int y = pointDefaults[i][1];
-        PF_ADD_POINT(label.str().c_str(), x, y, false, PARAM_DST_1 + i);
+        PF_ADD_POINT(label.str().c_str(), x, y, false,
+                     i < 4 ? DISK_ID_DST_1 + i : DISK_ID_DST_5 + i - 4);
     }
 
     AEFX_CLR_STRUCT(def);
     PF_ADD_BUTTON("", "Copy Src->Dst", 0, PF_ParamFlag_SUPERVISE,
-                  PARAM_COPY_SRC_TO_DST);
+                  DISK_ID_COPY_SRC_TO_DST);
 
     AEFX_CLR_STRUCT(def);
     PF_ADD_BUTTON("", "Swap Src/Dst", 0, PF_ParamFlag_SUPERVISE,
-                  PARAM_SWAP_SRC_DST);
+                  DISK_ID_SWAP_SRC_DST);
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_CHECKBOX("Motion Blur",
+                    "Motion Blur",
+                    FALSE,
+                    0,
+                    DISK_ID_MOTION_BLUR);
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_FLOAT_SLIDER("Shutter Angle",       // NAME
+                        0,                     // VALID_MIN,
+                        720,                   // VALID_MAX
+                        0,                     // SLIDER_MIN
+                        360,                   // SLIDER_MAX
+                        0,                     // CURVE_TORELANCE
+                        180,                   // DFLT
+                        1,                     // PREC
+                        0,                     // DISP
+                        0,                     // WANT_PHASE
+                        DISK_ID_SHUTTER_ANGLE);  // ID
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_SLIDER("Samples",
+                  2,
+                  MOTION_BLUR_MAX_SAMPLES,
+                  2,
+                  MOTION_BLUR_MAX_SAMPLES,
+                  8,
+                  DISK_ID_SAMPLES);
 
     out_data->num_params = PARAM_NUM_PARAMS;
 
@@ -140,138 +181,440 @@ static PF_Err GlobalSetdown(PF_InData *in_data, PF_OutData *out_data,
         suites.HandleSuite1()->host_lock_handle(in_data->global_data));
 
     // Explicitly call deconstructor
-    globalData->inputTexture.~Texture();
-    globalData->program.~Shader();
-    globalData->fbo.~Fbo();
-    globalData->quad.~QuadVao();
+    if (globalData->globalContext.initialized) {
+        globalData->inputTextureCache.~TextureCache();
+        globalData->program.~Shader();
+        globalData->fbo.~Fbo();
+        globalData->quad.~QuadVao();
+    }
     globalData->globalContext.~GlobalContext();
+    globalData->pyramidCache.~MipPyramidCache();
 
     suites.HandleSuite1()->host_dispose_handle(in_data->global_data);
 
     return err;
 }
 
-static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
-                        PF_PreRenderExtra *extra) {
-    PF_Err err = PF_Err_NONE;
-    AEGP_SuiteHandler suites(in_data->pica_basicP);
-    auto handleSuite = suites.HandleSuite1();
+// Integer rect around the extent, grown by the margin and kept within
+// MAX_RESULT_EXTENT
+static void SetBounds(double minX, double minY, double maxX, double maxY,
+                      A_long margin, PF_LRect *bounds) {
+    bounds->left = (A_long)std::floor(std::max(minX, -(double)MAX_RESULT_EXTENT));
+    bounds->top = (A_long)std::floor(std::max(minY, -(double)MAX_RESULT_EXTENT));
+    bounds->right = (A_long)std::ceil(std::min(maxX, (double)MAX_RESULT_EXTENT));
+    bounds->bottom = (A_long)std::ceil(std::min(maxY, (double)MAX_RESULT_EXTENT));
+    AEUtils::growRect(bounds, margin, margin);
+}
 
-    PF_RenderRequest req = extra->input->output_request;
-    PF_CheckoutResult in_result;
+// Bounds of the rect mapped by the transform, clipped to the part in front
+// of the horizon and grown by the margin. Returns false when all of it is
+// behind the horizon.
+static bool GetMappedBounds(const Homography::Matrix &mat, const PF_LRect *rect,
+                            A_long margin, PF_LRect *bounds) {
+    Homography::Point corners[4] = {{(double)rect->left, (double)rect->top},
+                                    {(double)rect->right, (double)rect->top},
+                                    {(double)rect->right, (double)rect->bottom},
+                                    {(double)rect->left, (double)rect->bottom}};
 
-    // Create paramInfo
-    PF_Handle paramInfoH = handleSuite->host_new_handle(sizeof(ParamInfo));
+    double maxWeight = 0;
 
-    if (!paramInfoH) {
-        return PF_Err_OUT_OF_MEMORY;
+    for (int i = 0; i < 4; i++) {
+        maxWeight = std::max(maxWeight, Homography::weight(mat, corners[i]));
     }
 
-    // Set handler
-    extra->output->pre_render_data = paramInfoH;
+    Homography::Point clipped[5];
+    int count = maxWeight > 0 ? Homography::clipToFront(mat, corners, 4,
+                                                        maxWeight * HORIZON_MIN_WEIGHT,
+                                                        clipped)
+                              : 0;
 
-    ParamInfo *paramInfo = reinterpret_cast<ParamInfo *>(
-        handleSuite->host_lock_handle(paramInfoH));
+    if (count == 0) {
+        bounds->left = bounds->top = bounds->right = bounds->bottom = 0;
+        return false;
+    }
 
-    if (!paramInfo) {
-        err = PF_Err_OUT_OF_MEMORY;
+    double minX = MAX_RESULT_EXTENT, minY = MAX_RESULT_EXTENT;
+    double maxX = -MAX_RESULT_EXTENT, maxY = -MAX_RESULT_EXTENT;
+
+    for (int i = 0; i < count; i++) {
+        Homography::Point p = Homography::apply(mat, clipped[i]);
+        minX = std::min(minX, p.x);
+        minY = std::min(minY, p.y);
+        maxX = std::max(maxX, p.x);
+        maxY = std::max(maxY, p.y);
     }
 
-    A_long viewingMode;
-    ERR(AEOGLInterop::getPopupParam(in_data, out_data, PARAM_EDITING_MODE,
-                                    &viewingMode));
-    A_long pinCount;
+    SetBounds(minX, minY, maxX, maxY, margin, bounds);
 
-    if (viewingMode == PARAM_EDITING_MODE_SRC) {
-        pinCount = 0;
-    } else {
-        ERR(AEOGLInterop::getPopupParam(in_data, out_data, PARAM_PINCOUNT,
-                                        &pinCount));
+    return true;
+}
+
+// Number of mesh grid nodes along each side of the rect, at a spacing of
+// MESH_GRID_SPACING from the center of its first pixel and reaching past its
+// last one
+static void GetMeshGridSize(const PF_LRect *rect, A_long *cols, A_long *rows) {
+    *cols = (rect->right - rect->left - 1) / MESH_GRID_SPACING + 2;
+    *rows = (rect->bottom - rect->top - 1) / MESH_GRID_SPACING + 2;
+}
+
+// Bounds of the mesh warp over a lattice of cols x rows points, from the
+// pins p to the pins q. The warp is smooth, so its extremes fall close to
+// the lattice at a fine enough spacing.
+static void GetMeshBounds(const Homography::Point *p, const Homography::Point *q,
+                          int n, double x0, double y0, double spacingX,
+                          double spacingY, A_long cols, A_long rows, A_long margin,
+                          PF_LRect *bounds) {
+    double minX = MAX_RESULT_EXTENT, minY = MAX_RESULT_EXTENT;
+    double maxX = -MAX_RESULT_EXTENT, maxY = -MAX_RESULT_EXTENT;
+
+    for (A_long j = 0; j < rows; j++) {
+        for (A_long i = 0; i < cols; i++) {
+            Homography::Point v = {x0 + i * spacingX, y0 + j * spacingY};
+            Homography::Point r = MovingLeastSquares::apply(p, q, n, v);
+            minX = std::min(minX, r.x);
+            minY = std::min(minY, r.y);
+            maxX = std::max(maxX, r.x);
+            maxY = std::max(maxY, r.y);
+        }
+    }
+
+    SetBounds(minX, minY, maxX, maxY, margin, bounds);
+}
+
+// Pick the cheapest way to render the transform. Identities and translations
+// by whole pixels only move pixels around, and affine transforms have no
+// perspective divide.
+static A_long GetWarpMode(const Homography::Matrix &mat, A_long *offsetX,
+                          A_long *offsetY) {
+    const double(*m)[3] = mat.m;
+
+    if (m[2][0] != 0 || m[2][1] != 0 || m[2][2] != 1) {
+        return WARP_MODE_PERSPECTIVE;
     }
 
-    A_FloatPoint src1, src2, src3, src4;
-    A_FloatPoint dst1, dst2, dst3, dst4;
+    double x = std::round(m[0][2]), y = std::round(m[1][2]);
+    bool offset = std::abs(m[0][0] - 1) * MAX_RESULT_EXTENT < OFFSET_TOLERANCE &&
+                  std::abs(m[1][1] - 1) * MAX_RESULT_EXTENT < OFFSET_TOLERANCE &&
+                  std::abs(m[0][1]) * MAX_RESULT_EXTENT < OFFSET_TOLERANCE &&
+                  std::abs(m[1][0]) * MAX_RESULT_EXTENT < OFFSET_TOLERANCE &&
+                  std::abs(m[0][2] - x) < OFFSET_TOLERANCE &&
+                  std::abs(m[1][2] - y) < OFFSET_TOLERANCE;
+
+    if (!offset) {
+        return WARP_MODE_AFFINE;
+    }
+
+    *offsetX = (A_long)x;
+    *offsetY = (A_long)y;
+    return WARP_MODE_OFFSET;
+}
+
+// Params read on every PreRender, before they are solved into ParamInfo
+struct PinParams {
+    A_long editingMode, pinCount;
+    PF_Boolean motionBlur;
+    PF_FpLong shutterAngle;
+    A_long numSamples;
+
+    // In layer pixels at full resolution
+    A_FloatPoint src[PIN_MAX_COUNT], dst[PIN_MAX_COUNT];
+};
+
+static constexpr ParamSchema::Entry PARAM_SCHEMA[] = {
+    ParamSchema::popup(PARAM_EDITING_MODE, PARAM_FIELD(PinParams, editingMode)),
+    ParamSchema::popup(PARAM_PINCOUNT, PARAM_FIELD(PinParams, pinCount)),
+    ParamSchema::checkbox(PARAM_MOTION_BLUR, PARAM_FIELD(PinParams, motionBlur)),
+    ParamSchema::floatSlider(PARAM_SHUTTER_ANGLE, PARAM_FIELD(PinParams, shutterAngle)),
+    ParamSchema::slider(PARAM_SAMPLES, PARAM_FIELD(PinParams, numSamples)),
+};
+
+// Pins at the time, in layer pixels at full resolution, checked out in a
+// single pass. The time step is in the same scale as the time.
+static PF_Err GetPins(PF_InData *in_data, PF_OutData *out_data, A_long time,
+                      A_long timeStep, A_u_long timeScale, A_long numPins, Homography::Point *src,
+                      Homography::Point *dst) {
+    PF_Err err = PF_Err_NONE;
+
+    PinParams params;
+    AEFX_CLR_STRUCT(params);
+
+    const ParamSchema::Entry schema[] = {
+        ParamSchema::points(PARAM_SRC_1, ParamSchema::AE_SPACE,
+                            PARAM_FIELD(PinParams, src), numPins),
+        ParamSchema::points(PARAM_DST_1, ParamSchema::AE_SPACE,
+                            PARAM_FIELD(PinParams, dst), numPins),
+    };
 
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_SRC_1,
-                                    AEOGLInterop::AE_SPACE, &src1));
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_SRC_2,
-                                    AEOGLInterop::AE_SPACE, &src2));
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_SRC_3,
-                                    AEOGLInterop::AE_SPACE, &src3));
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_SRC_4,
-                                    AEOGLInterop::AE_SPACE, &src4));
+    ERR(ParamSchema::checkout(in_data, out_data, schema, &params, time, timeStep,
+                              timeScale));
 
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_DST_1,
-                                    AEOGLInterop::AE_SPACE, &dst1));
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_DST_2,
-                                    AEOGLInterop::AE_SPACE, &dst2));
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_DST_3,
-                                    AEOGLInterop::AE_SPACE, &dst3));
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_DST_4,
-                                    AEOGLInterop::AE_SPACE, &dst4));
+    for (int i = 0; i < numPins; i++) {
+        src[i] = {params.src[i].x, params.src[i].y};
+        dst[i] = {params.dst[i].x, params.dst[i].y};
+    }
+
+    return err;
+}
 
-    glm::mat3 xform = glm::mat3(1);
+// Transform taking the source pins to the destination ones, oriented so that
+// the layer lies in front of the horizon. Meshes and degenerate pins leave
+// the layer untransformed.
+static Homography::Matrix SolvePins(A_long pinCount, const Homography::Point *srcPins,
+                                    const Homography::Point *dstPins) {
+    Homography::Point src[4] = {srcPins[0], srcPins[1], srcPins[2], srcPins[3]};
+    Homography::Point dst[4] = {dstPins[0], dstPins[1], dstPins[2], dstPins[3]};
+    Homography::Matrix mat = Homography::identity();
 
     switch (pinCount) {
         case 0:  // Original
             break;
-        case 1: {  // Translate
-            glm::vec2 trans(dst1.x - src1.x, dst1.y - src1.y);
-            xform = glm::translate(xform, trans);
+        case 1:  // Translate
+            mat = Homography::translate(src[0], dst[0]);
             break;
-        }
         case 2:
         case 3: {  // Affine transformation
-            std::vector<cv::Point2f> srcPoints(3);
-            srcPoints[0] = cv::Point2f(src1.x, src1.y);
-            srcPoints[1] = cv::Point2f(src2.x, src2.y);
-            srcPoints[2] = pinCount == 2 ? cv::Point2f(src1.x - (src2.y - src1.y),
-                                                       src1.y + (src2.x - src1.x))
-                                         : cv::Point2f(src3.x, src3.y);
-
-            std::vector<cv::Point2f> dstPoints(3);
-            dstPoints[0] = cv::Point2f(dst1.x, dst1.y);
-            dstPoints[1] = cv::Point2f(dst2.x, dst2.y);
-            dstPoints[2] = pinCount == 2 ? cv::Point2f(dst1.x - (dst2.y - dst1.y),
-                                                       dst1.y + (dst2.x - dst1.x))
-                                         : cv::Point2f(dst3.x, dst3.y);
-
-            cv::Mat mat = cv::getAffineTransform(srcPoints, dstPoints);
-
-            for (int i = 0; i < 3; i++) {
-                for (int j = 0; j < 2; j++) {
-                    xform[i][j] = (float)mat.at<double>(j, i);
-                }
+            // Two pins complete the triangle with a third point at a right
+            // angle, so that the transform has no skew
+            if (pinCount == 2) {
+                src[2] = {src[0].x - (src[1].y - src[0].y),
+                          src[0].y + (src[1].x - src[0].x)};
+                dst[2] = {dst[0].x - (dst[1].y - dst[0].y),
+                          dst[0].y + (dst[1].x - dst[0].x)};
             }
+
+            Homography::affine(src, dst, &mat);
             break;
         }
         case 4: {  // Homogeneous transformation
-            std::vector<cv::Point2f> srcPoints(4);
-            srcPoints[0] = cv::Point2f(src1.x, src1.y);
-            srcPoints[1] = cv::Point2f(src2.x, src2.y);
-            srcPoints[2] = cv::Point2f(src4.x, src4.y);
-            srcPoints[3] = cv::Point2f(src3.x, src3.y);
-
-            std::vector<cv::Point2f> dstPoints(4);
-            dstPoints[0] = cv::Point2f(dst1.x, dst1.y);
-            dstPoints[1] = cv::Point2f(dst2.x, dst2.y);
-            dstPoints[2] = cv::Point2f(dst4.x, dst4.y);
-            dstPoints[3] = cv::Point2f(dst3.x, dst3.y);
-
-            cv::Mat mat = cv::getPerspectiveTransform(srcPoints, dstPoints);
-
-            for (int i = 0; i < 3; i++) {
-                for (int j = 0; j < 3; j++) {
-                    xform[i][j] = (float)mat.at<double>(j, i);
+            // Pins are placed in Z order, while quads run around the corners
+            Homography::Point srcQuad[4] = {src[0], src[1], src[3], src[2]};
+            Homography::Point dstQuad[4] = {dst[0], dst[1], dst[3], dst[2]};
+
+            Homography::perspective(srcQuad, dstQuad, &mat);
+            break;
+        }
+        default:  // Mesh, warped by the pins themselves
+            break;
+    }
+
+    // The middle of the pins is kept in front of the horizon
+    Homography::Point middle = {(src[0].x + src[1].x + src[2].x + src[3].x) / 4,
+                                (src[0].y + src[1].y + src[2].y + src[3].y) / 4};
+    Homography::orient(&mat, pinCount == 4 ? middle : src[0]);
+
+    return mat;
+}
+
+static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
+                        PF_PreRenderExtra *extra) {
+    PF_Err err = PF_Err_NONE;
+
+    PF_RenderRequest req = extra->input->output_request;
+    PF_CheckoutResult in_result;
+
+    // Take paramInfo from the pool, which AE gives back once rendered
+    ParamInfo *paramInfo = PreRenderPool<ParamInfo>::acquire();
+
+    if (!paramInfo) {
+        return PF_Err_OUT_OF_MEMORY;
+    }
+
+    // Set handler
+    extra->output->pre_render_data = paramInfo;
+    extra->output->delete_pre_render_data_func = PreRenderPool<ParamInfo>::release;
+
+    PinParams params;
+    AEFX_CLR_STRUCT(params);
+    ERR(ParamSchema::checkout(in_data, out_data, PARAM_SCHEMA, &params));
+
+    A_long pinCount =
+        params.editingMode == PARAM_EDITING_MODE_SRC ? 0 : params.pinCount;
+    PF_Boolean motionBlur = params.motionBlur;
+    PF_FpLong shutterAngle = params.shutterAngle;
+    A_long numSamples = params.numSamples;
+
+    // Unused pins are read up to the fourth, whose middle orients the
+    // transform
+    A_long numPins = std::max(pinCount, (A_long)4);
+    Homography::Point src[PIN_MAX_COUNT], dst[PIN_MAX_COUNT];
+    ERR(GetPins(in_data, out_data, in_data->current_time, in_data->time_step,
+                in_data->time_scale, numPins, src, dst));
+
+    // From here on, the transform works in layer pixels at the current
+    // downsampling
+    double downsampleX = (double)in_data->downsample_x.num / in_data->downsample_x.den;
+    double downsampleY = (double)in_data->downsample_y.num / in_data->downsample_y.den;
+
+    Homography::Matrix scale = {{{downsampleX, 0, 0}, {0, downsampleY, 0}, {0, 0, 1}}};
+    Homography::Matrix unscale = {
+        {{1 / downsampleX, 0, 0}, {0, 1 / downsampleY, 0}, {0, 0, 1}}};
+    Homography::Matrix mat = Homography::multiply(
+        scale, Homography::multiply(SolvePins(pinCount, src, dst), unscale));
+
+    PF_LRect layerRect;
+    layerRect.left = layerRect.top = 0;
+    layerRect.right = (A_long)std::ceil(in_data->width * downsampleX);
+    layerRect.bottom = (A_long)std::ceil(in_data->height * downsampleY);
+
+    bool mesh = pinCount > 4;
+
+    // Motion blur samples the transform at times spread evenly across the
+    // shutter, centered on the frame. Meshes are left unblurred.
+    Homography::Matrix sampleMats[MOTION_BLUR_MAX_SAMPLES];
+
+    if (!motionBlur || mesh || shutterAngle <= 0) {
+        numSamples = 1;
+    }
+
+    numSamples = std::min(std::max(numSamples, (A_long)1), (A_long)MOTION_BLUR_MAX_SAMPLES);
+    sampleMats[0] = mat;
+
+    if (numSamples > 1) {
+        // Params are read in a time scale subdividing the frame finely
+        // enough to tell the samples apart
+        A_long step = std::max(std::abs(in_data->time_step), (A_long)1);
+        A_long subdivision = std::max((4 * numSamples + step - 1) / step, (A_long)1);
+        bool moving = false;
+
+        for (A_long k = 0; !err && k < numSamples; k++) {
+            double phase = ((k + 0.5) / numSamples - 0.5) * shutterAngle / 360;
+            A_long time = in_data->current_time * subdivision +
+                          (A_long)std::round(phase * in_data->time_step * subdivision);
+
+            Homography::Point sampleSrc[PIN_MAX_COUNT], sampleDst[PIN_MAX_COUNT];
+            ERR(GetPins(in_data, out_data, time, in_data->time_step * subdivision,
+                        in_data->time_scale * subdivision, numPins, sampleSrc,
+                        sampleDst));
+
+            sampleMats[k] = Homography::multiply(
+                scale, Homography::multiply(SolvePins(pinCount, sampleSrc, sampleDst),
+                                            unscale));
+            moving |= std::memcmp(&sampleMats[k], &mat, sizeof(mat)) != 0;
+        }
+
+        // Pins holding still across the shutter need no blur
+        if (!moving) {
+            numSamples = 1;
+            sampleMats[0] = mat;
+        }
+    }
+
+    for (int i = 0; i < numPins; i++) {
+        src[i] = {src[i].x * downsampleX, src[i].y * downsampleY};
+        dst[i] = {dst[i].x * downsampleX, dst[i].y * downsampleY};
+    }
+
+    if (!err) {
+        paramInfo->pinCount = pinCount;
+        paramInfo->mat = mat;
+
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                paramInfo->xform[i][j] = (float)mat.m[j][i];
+            }
+        }
+
+        paramInfo->numSamples = numSamples;
+
+        for (A_long k = 0; k < numSamples; k++) {
+            paramInfo->sampleMats[k] = sampleMats[k];
+        }
+
+        Homography::Point corners[4] = {
+            {(double)layerRect.left, (double)layerRect.top},
+            {(double)layerRect.right, (double)layerRect.top},
+            {(double)layerRect.right, (double)layerRect.bottom},
+            {(double)layerRect.left, (double)layerRect.bottom}};
+
+        paramInfo->horizon = false;
+
+        for (A_long k = 0; k < numSamples; k++) {
+            for (int i = 0; i < 4; i++) {
+                paramInfo->horizon |= Homography::weight(sampleMats[k], corners[i]) <= 0;
+            }
+        }
+
+        paramInfo->offsetX = paramInfo->offsetY = 0;
+        paramInfo->warpMode =
+            mesh ? WARP_MODE_MESH
+                 : GetWarpMode(mat, &paramInfo->offsetX, &paramInfo->offsetY);
+
+        // Blurred samples are never a plain copy, and skip the divide only if
+        // all of them are affine
+        if (numSamples > 1) {
+            A_long offsetX, offsetY;
+            paramInfo->warpMode = WARP_MODE_AFFINE;
+
+            for (A_long k = 0; k < numSamples; k++) {
+                if (GetWarpMode(sampleMats[k], &offsetX, &offsetY) ==
+                    WARP_MODE_PERSPECTIVE) {
+                    paramInfo->warpMode = WARP_MODE_PERSPECTIVE;
                 }
             }
         }
+
+        for (int i = 0; i < numPins; i++) {
+            paramInfo->srcPins[i] = src[i];
+            paramInfo->dstPins[i] = dst[i];
+        }
+    }
+
+    // The output covers the layer as transformed, and the input only what
+    // maps into the requested part of it, plus the bilinear footprint.
+    // Across the horizon, both are clipped to the part in front of it. With
+    // motion blur, both cover all the samples, so that a single checkout of
+    // the input serves them all.
+    PF_LRect outputBounds = {0, 0, 0, 0}, inputRect = {0, 0, 0, 0};
+
+    if (mesh) {
+        // The mesh is rendered by its inverse, which the forward warp of the
+        // layer only approximates, so its bounds are grown by a grid cell
+        double spacingX = (double)layerRect.right / MESH_BOUNDS_SAMPLES;
+        double spacingY = (double)layerRect.bottom / MESH_BOUNDS_SAMPLES;
+        GetMeshBounds(src, dst, pinCount, 0, 0, spacingX, spacingY,
+                      MESH_BOUNDS_SAMPLES + 1, MESH_BOUNDS_SAMPLES + 1,
+                      MESH_GRID_SPACING, &outputBounds);
+    } else {
+        for (A_long k = 0; k < numSamples; k++) {
+            Homography::Matrix inverse;
+            PF_LRect bounds;
+
+            if (Homography::invert(sampleMats[k], &inverse) &&
+                GetMappedBounds(sampleMats[k], &layerRect, 0, &bounds)) {
+                UnionLRect(&bounds, &outputBounds);
+            }
+        }
+    }
+
+    PF_LRect outputRect = req.rect;
+    AEUtils::intersectRect(&outputBounds, &outputRect);
+
+    if (mesh && !AEUtils::isEmptyRect(&outputRect)) {
+        // The same grid nodes as the render interpolates between
+        A_long cols, rows;
+        GetMeshGridSize(&outputRect, &cols, &rows);
+        GetMeshBounds(dst, src, pinCount, outputRect.left + 0.5, outputRect.top + 0.5,
+                      MESH_GRID_SPACING, MESH_GRID_SPACING, cols, rows, 1,
+                      &inputRect);
+    } else if (!AEUtils::isEmptyRect(&outputRect)) {
+        for (A_long k = 0; k < numSamples; k++) {
+            Homography::Matrix inverse;
+            PF_LRect bounds;
+
+            if (Homography::invert(sampleMats[k], &inverse) &&
+                GetMappedBounds(inverse, &outputRect, 1, &bounds)) {
+                UnionLRect(&bounds, &inputRect);
+            }
+        }
     }
-    std::memcpy(&paramInfo->xform, &xform, sizeof(glm::mat3));
 
-    handleSuite->host_unlock_handle(paramInfoH);
+    if (!AEUtils::isEmptyRect(&inputRect)) {
+        AEUtils::intersectRect(&layerRect, &inputRect);
+    }
 
     // Checkout input image
+    req.rect = inputRect;
+
     ERR(extra->cb->checkout_layer(in_data->effect_ref, PARAM_INPUT, PARAM_INPUT,
                                   &req, in_data->current_time,
                                   in_data->time_step, in_data->time_scale,
@@ -279,13 +622,451 @@ static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
 
     // Compute the rect to render
     if (!err) {
-        UnionLRect(&in_result.result_rect, &extra->output->result_rect);
-        UnionLRect(&in_result.max_result_rect, &extra->output->max_result_rect);
+        paramInfo->inputRect = in_result.result_rect;
+        paramInfo->outputRect = outputRect;
+        paramInfo->layerRect = layerRect;
+
+        UnionLRect(&outputRect, &extra->output->result_rect);
+        UnionLRect(&outputBounds, &extra->output->max_result_rect);
+    }
+
+    return err;
+}
+
+static PF_Err WarpBand(void *refconPV, A_long thread_indexL, A_long i,
+                       A_long iterationsL) {
+    WarpRefcon *refcon = reinterpret_cast<WarpRefcon *>(refconPV);
+
+    A_long yStart = i * WARP_BAND_ROWS;
+    A_long yEnd = std::min(yStart + WARP_BAND_ROWS, refcon->output_worldP->height);
+
+    switch (refcon->format) {
+        case PF_PixelFormat_ARGB32:
+            WarpRows<PF_Pixel8>(refcon, yStart, yEnd);
+            break;
+        case PF_PixelFormat_ARGB64:
+            WarpRows<PF_Pixel16>(refcon, yStart, yEnd);
+            break;
+        case PF_PixelFormat_ARGB128:
+            WarpRows<PF_PixelFloat>(refcon, yStart, yEnd);
+            break;
     }
 
+    return PF_ABORT(refcon->in_data);
+}
+
+struct PyramidRefcon {
+    PF_InData *in_data;
+    MipPyramid *pyramid;
+    PF_PixelFormat format;
+    int level;
+};
+
+static PF_Err PyramidBand(void *refconPV, A_long thread_indexL, A_long i,
+                          A_long iterationsL) {
+    PyramidRefcon *refcon = reinterpret_cast<PyramidRefcon *>(refconPV);
+
+    A_long yStart = i * WARP_BAND_ROWS;
+    A_long yEnd = std::min(yStart + WARP_BAND_ROWS,
+                           refcon->pyramid->getLevel(refcon->level)->height);
+
+    switch (refcon->format) {
+        case PF_PixelFormat_ARGB32:
+            refcon->pyramid->downsampleRows<PF_Pixel8>(refcon->level, yStart, yEnd);
+            break;
+        case PF_PixelFormat_ARGB64:
+            refcon->pyramid->downsampleRows<PF_Pixel16>(refcon->level, yStart, yEnd);
+            break;
+        case PF_PixelFormat_ARGB128:
+            refcon->pyramid->downsampleRows<PF_PixelFloat>(refcon->level, yStart,
+                                                           yEnd);
+            break;
+    }
+
+    return PF_ABORT(refcon->in_data);
+}
+
+// Pyramid of the input down to the given level. Pyramids are kept across
+// renders of the same layer pixels, so only the levels missing are built,
+// one at a time, each across threads. Levels left unbuilt by an abort are
+// dropped again.
+static PF_Err GetPyramid(PF_InData *in_data, MipPyramidCache *cache,
+                         const PF_EffectWorld *input_worldP, PF_PixelFormat format,
+                         int numLevels, const MipPyramid **pyramidP) {
+    PF_Err err = PF_Err_NONE;
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+
+    MipPyramid *pyramid = cache->getPyramid(input_worldP, format);
+    int firstLevel = pyramid->getNumLevels();
+
+    switch (format) {
+        case PF_PixelFormat_ARGB32:
+            pyramid->extend<PF_Pixel8>(numLevels);
+            break;
+        case PF_PixelFormat_ARGB64:
+            pyramid->extend<PF_Pixel16>(numLevels);
+            break;
+        case PF_PixelFormat_ARGB128:
+            pyramid->extend<PF_PixelFloat>(numLevels);
+            break;
+    }
+
+    PyramidRefcon refcon = {in_data, pyramid, format, 0};
+
+    for (int k = firstLevel; !err && k < pyramid->getNumLevels(); k++) {
+        refcon.level = k;
+
+        A_long rows = pyramid->getLevel(k)->height;
+        A_long bands = (rows + WARP_BAND_ROWS - 1) / WARP_BAND_ROWS;
+        ERR(suites.Iterate8Suite1()->iterate_generic(bands, &refcon, PyramidBand));
+    }
+
+    if (err) {
+        pyramid->truncate(firstLevel);
+    }
+
+    *pyramidP = pyramid;
+
+    return err;
+}
+
+// Number of pyramid levels the warp reaches down to, from the largest
+// footprint of an output pixel among the corners and the center of the
+// output. Pixels behind the horizon don't count.
+static int GetPyramidLevels(const Homography::Matrix &inverse,
+                            const PF_EffectWorld *output_worldP) {
+    const double(*m)[3] = inverse.m;
+    double width = output_worldP->width, height = output_worldP->height;
+    Homography::Point points[5] = {
+        {0.5, 0.5}, {width - 0.5, 0.5}, {0.5, height - 0.5},
+        {width - 0.5, height - 0.5}, {width / 2, height / 2}};
+
+    double major = 0;
+
+    for (const Homography::Point &p : points) {
+        double hw = Homography::weight(inverse, p);
+
+        if (hw <= 0) {
+            continue;
+        }
+
+        Homography::Point q = Homography::apply(inverse, p);
+        double dudx = (m[0][0] - q.x * m[2][0]) / hw;
+        double dvdx = (m[1][0] - q.y * m[2][0]) / hw;
+        double dudy = (m[0][1] - q.x * m[2][1]) / hw;
+        double dvdy = (m[1][1] - q.y * m[2][1]) / hw;
+
+        major = std::max(major, std::sqrt(dudx * dudx + dvdx * dvdx));
+        major = std::max(major, std::sqrt(dudy * dudy + dvdy * dvdy));
+    }
+
+    if (!(major > 1)) {
+        return 0;
+    }
+
+    return (int)std::min(std::ceil(std::log2(major)), (double)MIP_MAX_LEVELS);
+}
+
+// Warp on the CPU, with the output split into bands of rows across threads
+static PF_Err WarpCPU(PF_InData *in_data, const PF_EffectWorld *input_worldP,
+                      PF_EffectWorld *output_worldP, PF_PixelFormat format,
+                      const ParamInfo *paramInfo, MipPyramidCache *pyramidCache) {
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+
+    // Nothing of the layer maps into the output
+    if (AEUtils::isEmptyRect(&paramInfo->inputRect)) {
+        std::memset(output_worldP->data, 0,
+                    (size_t)output_worldP->rowbytes * output_worldP->height);
+        return PF_Err_NONE;
+    }
+
+    WarpRefcon refcon;
+    refcon.in_data = in_data;
+    refcon.input_worldP = input_worldP;
+    refcon.output_worldP = output_worldP;
+    refcon.format = format;
+    refcon.nearest = AEUtils::isDraftQuality(in_data);
+    refcon.affine = paramInfo->warpMode != WARP_MODE_PERSPECTIVE;
+    refcon.pyramid = nullptr;
+
+    // From output world pixels to input world pixels through the layer. A
+    // singular transform maps every pixel onto the horizon, leaving the
+    // output transparent.
+    const PF_LRect *inputRect = &paramInfo->inputRect;
+    const PF_LRect *outputRect = &paramInfo->outputRect;
+
+    Homography::Matrix fromOutput = {
+        {{1, 0, (double)outputRect->left}, {0, 1, (double)outputRect->top}, {0, 0, 1}}};
+    Homography::Matrix toInput = {
+        {{1, 0, -(double)inputRect->left}, {0, 1, -(double)inputRect->top}, {0, 0, 1}}};
+
+    double left = paramInfo->layerRect.left - inputRect->left;
+    double top = paramInfo->layerRect.top - inputRect->top;
+    double right = paramInfo->layerRect.right - inputRect->left;
+    double bottom = paramInfo->layerRect.bottom - inputRect->top;
+
+    refcon.numSamples = paramInfo->numSamples;
+
+    for (A_long k = 0; k < refcon.numSamples; k++) {
+        Homography::Matrix inverse = {};
+
+        Homography::invert(paramInfo->sampleMats[k], &inverse);
+        SetWarpSample(&refcon, k,
+                      Homography::multiply(toInput, Homography::multiply(inverse, fromOutput)),
+                      left, top, right, bottom);
+    }
+
+    // Strong downscaling aliases with bilinear taps alone, so the input is
+    // filtered down as far as the warp minifies it
+    PF_Err err = PF_Err_NONE;
+    int numLevels = 0;
+
+    for (A_long k = 0; !refcon.nearest && k < refcon.numSamples; k++) {
+        numLevels = std::max(numLevels, GetPyramidLevels(refcon.inverse[k], output_worldP));
+    }
+
+    if (numLevels > 0) {
+        ERR(GetPyramid(in_data, pyramidCache, input_worldP, format, numLevels,
+                       &refcon.pyramid));
+    }
+
+    A_long bands = (output_worldP->height + WARP_BAND_ROWS - 1) / WARP_BAND_ROWS;
+    ERR(suites.Iterate8Suite1()->iterate_generic(bands, &refcon, WarpBand));
+
+    return err;
+}
+
+struct MeshRefcon {
+    PF_InData *in_data;
+    const PF_EffectWorld *input_worldP;
+    PF_EffectWorld *output_worldP;
+    PF_PixelFormat format;
+    bool nearest;
+    const MipPyramid *pyramid;
+
+    // Input pixels the grid nodes map to, row by row
+    const Homography::Point *nodes;
+    A_long cols;
+
+    // Edges of the layer in input pixels
+    double left, top, right, bottom;
+};
+
+// Warp a row of the output by the mesh. Between each pair of grid nodes, the
+// source position moves by a constant step, and so do its derivatives over
+// the output. The distances to the edges of the layer are turned into output
+// pixels through the derivatives to estimate the coverage.
+template <typename PixelType>
+static void MeshRow(const MeshRefcon *refcon, A_long y) {
+    const PF_EffectWorld *input_worldP = refcon->input_worldP;
+    PF_EffectWorld *output_worldP = refcon->output_worldP;
+
+    PixelType *dstP = reinterpret_cast<PixelType *>(
+        (char *)output_worldP->data + y * output_worldP->rowbytes);
+    const PixelType transparent = {0, 0, 0, 0};
+
+    const double spacing = MESH_GRID_SPACING;
+    A_long j = y / MESH_GRID_SPACING;
+    double ty = (y - j * spacing) / spacing;
+
+    const Homography::Point *upper = refcon->nodes + j * refcon->cols;
+    const Homography::Point *lower = upper + refcon->cols;
+
+    for (A_long i = 0, x = 0; x < output_worldP->width; i++) {
+        double ax = upper[i].x + (lower[i].x - upper[i].x) * ty;
+        double ay = upper[i].y + (lower[i].y - upper[i].y) * ty;
+        double bx = upper[i + 1].x + (lower[i + 1].x - upper[i + 1].x) * ty;
+        double by = upper[i + 1].y + (lower[i + 1].y - upper[i + 1].y) * ty;
+
+        float dudx = (float)((bx - ax) / spacing);
+        float dvdx = (float)((by - ay) / spacing);
+        float dudy = (float)((lower[i].x + lower[i + 1].x - upper[i].x -
+                              upper[i + 1].x) / (2 * spacing));
+        float dvdy = (float)((lower[i].y + lower[i + 1].y - upper[i].y -
+                              upper[i + 1].y) / (2 * spacing));
+
+        // From input pixels to output pixels across the edges
+        double scaleU = 1 / std::max(std::sqrt(dudx * dudx + dudy * dudy), 1e-6f);
+        double scaleV = 1 / std::max(std::sqrt(dvdx * dvdx + dvdy * dvdy), 1e-6f);
+
+        A_long xEnd = std::min(x + MESH_GRID_SPACING, output_worldP->width);
+        double u = ax + dudx * (x - i * spacing), v = ay + dvdx * (x - i * spacing);
+
+        for (; x < xEnd; x++, u += dudx, v += dvdx) {
+            double d[4] = {(u - refcon->left) * scaleU, (refcon->right - u) * scaleU,
+                           (v - refcon->top) * scaleV, (refcon->bottom - v) * scaleV};
+            float coverage = 1;
+
+            for (int k = 0; k < 4; k++) {
+                // Edges stay hard in draft quality, like the homography
+                coverage *= refcon->nearest
+                                ? (d[k] >= 0 ? 1.0f : 0.0f)
+                                : (float)std::min(std::max(d[k] + 0.5, 0.0), 1.0);
+            }
+
+            if (coverage <= 0) {
+                dstP[x] = transparent;
+                continue;
+            }
+
+            PixelType pixel;
+
+            if (refcon->nearest) {
+                pixel = PixelSampler::sampleNearestPixel<PixelType>(
+                    input_worldP, (float)u, (float)v);
+            } else if (refcon->pyramid) {
+                pixel = refcon->pyramid->sampleAnisotropicFixed<PixelType>(
+                    (float)u, (float)v, dudx, dvdx, dudy, dvdy);
+            } else {
+                pixel = PixelSampler::sampleBilinearFixed<PixelType>(
+                    input_worldP, (float)u, (float)v);
+            }
+
+            if (coverage < 1) {
+                pixel = PixelSampler::scalePixel(pixel, coverage);
+            }
+
+            dstP[x] = pixel;
+        }
+    }
+}
+
+static PF_Err MeshBand(void *refconPV, A_long thread_indexL, A_long i,
+                       A_long iterationsL) {
+    MeshRefcon *refcon = reinterpret_cast<MeshRefcon *>(refconPV);
+
+    A_long yStart = i * WARP_BAND_ROWS;
+    A_long yEnd = std::min(yStart + WARP_BAND_ROWS, refcon->output_worldP->height);
+
+    for (A_long y = yStart; y < yEnd; y++) {
+        switch (refcon->format) {
+            case PF_PixelFormat_ARGB32:
+                MeshRow<PF_Pixel8>(refcon, y);
+                break;
+            case PF_PixelFormat_ARGB64:
+                MeshRow<PF_Pixel16>(refcon, y);
+                break;
+            case PF_PixelFormat_ARGB128:
+                MeshRow<PF_PixelFloat>(refcon, y);
+                break;
+        }
+    }
+
+    return PF_ABORT(refcon->in_data);
+}
+
+// Warp by the mesh on the CPU. The pins are only evaluated at the nodes of a
+// coarse grid over the output, so that the cost per pixel is the same as for
+// a homography, whatever the number of pins.
+static PF_Err WarpMeshCPU(PF_InData *in_data, const PF_EffectWorld *input_worldP,
+                          PF_EffectWorld *output_worldP, PF_PixelFormat format,
+                          const ParamInfo *paramInfo, MipPyramidCache *pyramidCache) {
+    PF_Err err = PF_Err_NONE;
+    AEGP_SuiteHandler suites(in_data->pica_basicP);
+
+    const PF_LRect *inputRect = &paramInfo->inputRect;
+    const PF_LRect *outputRect = &paramInfo->outputRect;
+
+    // Nothing of the layer maps into the output
+    if (AEUtils::isEmptyRect(inputRect)) {
+        std::memset(output_worldP->data, 0,
+                    (size_t)output_worldP->rowbytes * output_worldP->height);
+        return err;
+    }
+
+    PF_LRect gridRect = {outputRect->left, outputRect->top,
+                         outputRect->left + output_worldP->width,
+                         outputRect->top + output_worldP->height};
+    A_long cols, rows;
+    GetMeshGridSize(&gridRect, &cols, &rows);
+
+    // Inverse warp from the destination pins to the source ones, at the
+    // centers of the pixels the nodes fall on
+    std::vector<Homography::Point> nodes(cols * rows);
+
+    for (A_long j = 0; j < rows; j++) {
+        for (A_long i = 0; i < cols; i++) {
+            Homography::Point v = {outputRect->left + i * MESH_GRID_SPACING + 0.5,
+                                   outputRect->top + j * MESH_GRID_SPACING + 0.5};
+            Homography::Point r = MovingLeastSquares::apply(
+                paramInfo->dstPins, paramInfo->srcPins, paramInfo->pinCount, v);
+            nodes[j * cols + i] = {r.x - inputRect->left, r.y - inputRect->top};
+        }
+    }
+
+    MeshRefcon refcon;
+    refcon.in_data = in_data;
+    refcon.input_worldP = input_worldP;
+    refcon.output_worldP = output_worldP;
+    refcon.format = format;
+    refcon.nearest = AEUtils::isDraftQuality(in_data);
+    refcon.pyramid = nullptr;
+    refcon.nodes = nodes.data();
+    refcon.cols = cols;
+    refcon.left = paramInfo->layerRect.left - inputRect->left;
+    refcon.top = paramInfo->layerRect.top - inputRect->top;
+    refcon.right = paramInfo->layerRect.right - inputRect->left;
+    refcon.bottom = paramInfo->layerRect.bottom - inputRect->top;
+
+    // The largest step between nodes bounds the minification
+    double major = 0;
+
+    for (A_long j = 0; j + 1 < rows; j++) {
+        for (A_long i = 0; i + 1 < cols; i++) {
+            const Homography::Point &n = nodes[j * cols + i];
+            const Homography::Point &right = nodes[j * cols + i + 1];
+            const Homography::Point &below = nodes[(j + 1) * cols + i];
+
+            major = std::max(major, std::hypot(right.x - n.x, right.y - n.y));
+            major = std::max(major, std::hypot(below.x - n.x, below.y - n.y));
+        }
+    }
+
+    major /= MESH_GRID_SPACING;
+
+    if (!refcon.nearest && major > 1) {
+        int numLevels =
+            (int)std::min(std::ceil(std::log2(major)), (double)MIP_MAX_LEVELS);
+        ERR(GetPyramid(in_data, pyramidCache, input_worldP, format, numLevels,
+                       &refcon.pyramid));
+    }
+
+    A_long bands = (output_worldP->height + WARP_BAND_ROWS - 1) / WARP_BAND_ROWS;
+    ERR(suites.Iterate8Suite1()->iterate_generic(bands, &refcon, MeshBand));
+
     return err;
 }
 
+// Copy the input moved by whole pixels to the output, row by row, clearing
+// the pixels nothing maps to
+static void CopyOffset(const PF_EffectWorld *input_worldP,
+                       PF_EffectWorld *output_worldP, size_t pixelBytes,
+                       A_long offsetX, A_long offsetY) {
+    // Span of output columns the input covers
+    A_long start = std::min(std::max(-offsetX, (A_long)0), output_worldP->width);
+    A_long end = std::max(std::min(input_worldP->width - offsetX, output_worldP->width),
+                          start);
+
+    for (A_long y = 0; y < output_worldP->height; y++) {
+        char *dstP = (char *)output_worldP->data + y * output_worldP->rowbytes;
+        A_long srcY = y + offsetY;
+
+        if (srcY < 0 || srcY >= input_worldP->height || start >= end) {
+            std::memset(dstP, 0, output_worldP->width * pixelBytes);
+            continue;
+        }
+
+        const char *srcP = (const char *)input_worldP->data +
+                           srcY * input_worldP->rowbytes +
+                           (start + offsetX) * pixelBytes;
+
+        std::memset(dstP, 0, start * pixelBytes);
+        std::memcpy(dstP + start * pixelBytes, srcP, (end - start) * pixelBytes);
+        std::memset(dstP + end * pixelBytes, 0,
+                    (output_worldP->width - end) * pixelBytes);
+    }
+}
+
 static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
                           PF_SmartRenderExtra *extra) {
     PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
@@ -299,8 +1080,7 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
     auto handleSuite = suites.HandleSuite1();
 
     ParamInfo *paramInfo =
-        reinterpret_cast<ParamInfo *>(handleSuite->host_lock_handle(
-            reinterpret_cast<PF_Handle>(extra->input->pre_render_data)));
+        reinterpret_cast<ParamInfo *>(extra->input->pre_render_data);
 
     // Checkout layer pixels
     ERR((extra->cb->checkout_layer_pixels(in_data->effect_ref, PARAM_INPUT,
@@ -319,8 +1099,55 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
     auto *globalData = reinterpret_cast<GlobalData *>(
         handleSuite->host_lock_handle(in_data->global_data));
 
+    // Identities and whole-pixel translations are plain copies
+    bool offset = paramInfo->warpMode == WARP_MODE_OFFSET;
+
+    if (!err && offset) {
+        FX_LOG_TIME_START(copyTime);
+
+        size_t pixelBytes = format == PF_PixelFormat_ARGB128  ? sizeof(PF_PixelFloat)
+                            : format == PF_PixelFormat_ARGB64 ? sizeof(PF_Pixel16)
+                                                              : sizeof(PF_Pixel8);
+
+        // From output world pixels to input world pixels
+        const PF_LRect *inputRect = &paramInfo->inputRect;
+        const PF_LRect *outputRect = &paramInfo->outputRect;
+
+        CopyOffset(input_worldP, output_worldP, pixelBytes,
+                   outputRect->left - paramInfo->offsetX - inputRect->left,
+                   outputRect->top - paramInfo->offsetY - inputRect->top);
+
+        FX_LOG_TIME_END(copyTime, "Copy");
+    }
+
+    // Small frames, or hosts without a GL context, are warped on the CPU.
+    // So are layers crossing the horizon, which the quad can't be drawn for,
+    // meshes, and empty inputs. Motion blur samples are added up in float on
+    // the CPU, since blending them in the framebuffer would round each one to
+    // the output depth.
+    bool mesh = paramInfo->warpMode == WARP_MODE_MESH;
+    bool cpu = mesh || paramInfo->numSamples > 1 ||
+               !globalData->globalContext.initialized ||
+               (double)output_worldP->width * output_worldP->height <=
+                   CPU_WARP_MAX_PIXELS ||
+               paramInfo->horizon || AEUtils::isEmptyRect(&paramInfo->inputRect);
+
+    if (!err && !offset && cpu) {
+        FX_LOG_TIME_START(warpTime);
+        if (mesh) {
+            ERR(WarpMeshCPU(in_data, input_worldP, output_worldP, format, paramInfo,
+                            &globalData->pyramidCache));
+        } else {
+            ERR(WarpCPU(in_data, input_worldP, output_worldP, format, paramInfo,
+                        &globalData->pyramidCache));
+        }
+        FX_LOG_TIME_END(warpTime, "Warp (CPU)");
+    }
+
     // OpenGL
-    if (!err) {
+    if (!err && !offset && !cpu) {
+        FX_LOG_TIME_START(warpTime);
+
         globalData->globalContext.bind();
 
         GLenum pixelType;
@@ -336,38 +1163,58 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
                 break;
         }
 
-        GLsizei width = input_worldP->width;
-        GLsizei height = input_worldP->height;
+        GLsizei width = output_worldP->width;
+        GLsizei height = output_worldP->height;
         size_t pixelBytes = AEOGLInterop::getPixelBytes(pixelType);
 
         // Setup render context
-        globalData->fbo.allocate(width, height, pixelType, GL_RGBA, 4);
-        globalData->inputTexture.allocate(width, height, GL_RGBA, pixelType);
+        globalData->fbo.allocate(width, height, GL_RGBA, pixelType);
 
-        // Allocate pixels buffer
+        // Allocate pixels buffer, shared by the upload and the readback
+        size_t bufferPixels =
+            std::max((size_t)width * height,
+                     (size_t)input_worldP->width * input_worldP->height);
         PF_Handle pixelsBufferH =
-            handleSuite->host_new_handle(width * height * pixelBytes);
+            handleSuite->host_new_handle(bufferPixels * pixelBytes);
         void *pixelsBufferP = reinterpret_cast<char *>(
             handleSuite->host_lock_handle(pixelsBufferH));
 
-        // Upload buffer to OpenGL texture
-        AEOGLInterop::uploadTexture(&globalData->inputTexture,
-                                    input_worldP, pixelsBufferP, pixelType);
+        // Upload buffer to OpenGL texture, unless the layer is already resident
+        OGL::Texture *inputTexture = globalData->inputTextureCache.getTexture(
+            input_worldP, pixelsBufferP, pixelType);
+
+        // Nearest-neighbor sampling is good enough while scrubbing. Otherwise
+        // minified pixels are filtered trilinearly from the mipmaps, which
+        // are generated once per uploaded layer.
+        bool draft = AEUtils::isDraftQuality(in_data);
+
+        if (draft) {
+            inputTexture->setFilter(GL_NEAREST);
+        } else {
+            globalData->inputTextureCache.generateMipmaps(inputTexture);
+            inputTexture->setFilter(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+        }
 
         // Bind
         globalData->program.bind();
         globalData->fbo.bind();
 
         // Set uniforms
-        globalData->program.setTexture("tex0", &globalData->inputTexture, 0);
+        globalData->program.setTexture("tex0", inputTexture, 0);
 
         float multiplier16bit = AEOGLInterop::getMultiplier16bit(pixelType);
         globalData->program.setFloat("multiplier16bit", multiplier16bit);
 
-        float actualWidth = (float)in_data->width;
-        float actualHeight = (float)in_data->height;
+        const PF_LRect *inputRect = &paramInfo->inputRect;
+        const PF_LRect *outputRect = &paramInfo->outputRect;
 
-        globalData->program.setVec2("resolution", actualWidth, actualHeight);
+        globalData->program.setVec2("inputOrigin", (float)inputRect->left,
+                                    (float)inputRect->top);
+        globalData->program.setVec2("inputSize", (float)input_worldP->width,
+                                    (float)input_worldP->height);
+        globalData->program.setVec2("outputOrigin", (float)outputRect->left,
+                                    (float)outputRect->top);
+        globalData->program.setVec2("outputSize", (float)width, (float)height);
 
         glm::mat3 xformInv = glm::inverse(paramInfo->xform);
         globalData->program.setMat3("xform", paramInfo->xform);
@@ -386,6 +1233,8 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
 
         handleSuite->host_unlock_handle(pixelsBufferH);
         handleSuite->host_dispose_handle(pixelsBufferH);
+
+        FX_LOG_TIME_END(warpTime, "Warp (GL)");
     }
 
     // Check in
@@ -425,7 +1274,7 @@ static PF_Err UserChangedParam(PF_InData *in_data, PF_OutData *out_data,
                 paramsCopy[i] = *params[i];
             }
 
-            for (size_t i = 0; i < 4; i++) {
+            for (size_t i = 0; i < PIN_MAX_COUNT; i++) {
                 bool availablePin = i + 1 <= pinCount;
                 if (availablePin && editingMode != PARAM_EDITING_MODE_DST) {
                     paramsCopy[PARAM_SRC_1 + i].ui_flags &= (~PF_PUI_DISABLED);
@@ -449,7 +1298,7 @@ static PF_Err UserChangedParam(PF_InData *in_data, PF_OutData *out_data,
         }
         case PARAM_COPY_SRC_TO_DST: {
             PF_ParamDef *paramSrc, *paramDst;
-            for (size_t i = 0; i < 4; i++) {
+            for (size_t i = 0; i < PIN_MAX_COUNT; i++) {
                 paramSrc = params[PARAM_SRC_1 + i];
                 paramDst = params[PARAM_DST_1 + i];
                 paramDst->u.td.x_value = paramSrc->u.td.x_value;
@@ -461,7 +1310,7 @@ static PF_Err UserChangedParam(PF_InData *in_data, PF_OutData *out_data,
         }
         case PARAM_SWAP_SRC_DST: {
             PF_ParamDef *paramSrc, *paramDst;
-            for (size_t i = 0; i < 4; i++) {
+            for (size_t i = 0; i < PIN_MAX_COUNT; i++) {
                 paramSrc = params[PARAM_SRC_1 + i];
                 paramDst = params[PARAM_DST_1 + i];
 
@@ -33,6 +33,14 @@ typedef unsigned short PixelType;
 #include "Smart_Utils.h"
 
 #include "../OGL.h"
+#include "Homography.hpp"
+#include "MipPyramid.hpp"
+#include "MipPyramidCache.hpp"
+#include "MovingLeastSquares.hpp"
+#include "PixelSampler.hpp"
+#include "PreRenderPool.hpp"
+#include "TextureCache.hpp"
+#include "WarpRows.hpp"
 
 #include <glm/glm.hpp>
 
@@ -51,30 +59,81 @@ typedef unsigned short PixelType;
 
 #define SLIDER_PRECISION 1
 
+// Frames up to this many pixels are warped on the CPU, as uploading and
+// reading back for the GL path costs more than the warp itself. Kept at the
+// original conservative size until tests/WarpBenchmark has been run on
+// hardware GL, which it is meant to be set from.
+#define CPU_WARP_MAX_PIXELS (1024 * 1024)
+
+// Parts of the layer mapping to a w below this fraction of the largest one
+// are treated as behind the horizon when bounding the transform, since they
+// map arbitrarily far away
+#define HORIZON_MIN_WEIGHT 1e-6
+
+// Transformed bounds are kept within this many pixels from the layer origin
+#define MAX_RESULT_EXTENT 30000
+
+// Most pins, of which more than four warp the layer as a mesh
+#define PIN_MAX_COUNT 8
+
+// Spacing in output pixels of the grid the mesh warp is evaluated on, with
+// positions in between interpolated bilinearly
+#define MESH_GRID_SPACING 16
+
+// Samples per side of the lattice the layer is mapped through to bound the
+// mesh warp
+#define MESH_BOUNDS_SAMPLES 32
+
+// Transforms within this many pixels of an integer offset are copied rather
+// than resampled
+#define OFFSET_TOLERANCE 1e-3
+
 enum { PARAM_EDITING_MODE_SRC = 1,
        PARAM_EDITING_MODE_DST,
        PARAM_EDITING_MODE_BOTH };
 
+// How the transform is rendered, from the cheapest
+enum { WARP_MODE_OFFSET = 0,
+       WARP_MODE_AFFINE,
+       WARP_MODE_PERSPECTIVE,
+       WARP_MODE_MESH };
+
 enum {
     PARAM_INPUT = 0,
     PARAM_EDITING_MODE,
     PARAM_PINCOUNT,
     PARAM_SRC_1,
-    PARAM_SRC_2,
-    PARAM_SRC_3,
-    PARAM_SRC_4,
-    PARAM_DST_1,
-    PARAM_DST_2,
-    PARAM_DST_3,
-    PARAM_DST_4,
-    PARAM_COPY_SRC_TO_DST,
+    PARAM_DST_1 = PARAM_SRC_1 + PIN_MAX_COUNT,
+    PARAM_COPY_SRC_TO_DST = PARAM_DST_1 + PIN_MAX_COUNT,
     PARAM_SWAP_SRC_DST,
+    PARAM_MOTION_BLUR,
+    PARAM_SHUTTER_ANGLE,
+    PARAM_SAMPLES,
     PARAM_NUM_PARAMS
 };
 
+// IDs the params are saved to projects with, which have to stay as they were
+// when the params were added, whatever their order in the list above. Pins
+// beyond the first four and the motion blur params were added later, after
+// the buttons.
+enum {
+    DISK_ID_EDITING_MODE = 1,
+    DISK_ID_PINCOUNT,
+    DISK_ID_SRC_1,
+    DISK_ID_DST_1 = DISK_ID_SRC_1 + 4,
+    DISK_ID_COPY_SRC_TO_DST = DISK_ID_DST_1 + 4,
+    DISK_ID_SWAP_SRC_DST,
+    DISK_ID_SRC_5,
+    DISK_ID_DST_5 = DISK_ID_SRC_5 + PIN_MAX_COUNT - 4,
+    DISK_ID_MOTION_BLUR = DISK_ID_DST_5 + PIN_MAX_COUNT - 4,
+    DISK_ID_SHUTTER_ANGLE,
+    DISK_ID_SAMPLES
+};
+
 struct GlobalData {
+    MipPyramidCache pyramidCache;
     OGL::GlobalContext globalContext;
-    OGL::Texture inputTexture;
+    AEOGLInterop::TextureCache inputTextureCache;
     OGL::Shader program;
     OGL::Fbo fbo;
     OGL::QuadVao quad;
@@ -82,7 +141,30 @@ struct GlobalData {
 
 struct ParamInfo {
     A_long pinCount;
+
+    // The transform in layer pixels at the current downsampling, oriented so
+    // that the layer lies in front of the horizon, and its float copy for GL
+    Homography::Matrix mat;
     glm::mat3x3 xform;
+
+    // Transforms across the shutter for motion blur, in the same space, or
+    // just the transform itself without blur
+    A_long numSamples;
+    Homography::Matrix sampleMats[MOTION_BLUR_MAX_SAMPLES];
+
+    // Whether a part of the layer falls behind the horizon in any sample,
+    // which only the CPU path handles
+    bool horizon;
+
+    // One of WARP_MODE_*, and the offset in pixels for WARP_MODE_OFFSET
+    A_long warpMode;
+    A_long offsetX, offsetY;
+
+    // Pins in layer pixels at the current downsampling, for WARP_MODE_MESH
+    Homography::Point srcPins[PIN_MAX_COUNT], dstPins[PIN_MAX_COUNT];
+
+    // In layer pixels
+    PF_LRect inputRect, outputRect, layerRect;
 };
 
 extern "C" {
@@ -51,11 +51,11 @@ resource 'PiPL' (16000) {
 		},
 		/* [10] */
 		AE_Effect_Global_OutFlags {
-		0x06000000
+		0x06000002
 
 		},
 		AE_Effect_Global_OutFlags_2 {
-            0x0001400
+            0x0021400
 		},
 		/* [11] */
 		AE_Effect_Match_Name {
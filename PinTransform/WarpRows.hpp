@@ -0,0 +1,278 @@
+#pragma once
+
+#include "AE_Effect.h"
+
+#include "Homography.hpp"
+#include "MipPyramid.hpp"
+#include "PixelSampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Most motion blur samples across the shutter
+#define MOTION_BLUR_MAX_SAMPLES 32
+
+// Number of output rows warped per job on the CPU
+#define WARP_BAND_ROWS 32
+
+// Inverse mapping of the output rows on the CPU, for homographies. The
+// caller splits the output into bands of rows and runs WarpRows on each,
+// across threads.
+
+struct WarpRefcon {
+    PF_InData *in_data;
+    const PF_EffectWorld *input_worldP;
+    PF_EffectWorld *output_worldP;
+    PF_PixelFormat format;
+    bool nearest;
+
+    // Whether the inverse has no perspective divide
+    bool affine;
+
+    // Levels of the input for minified pixels, or null when nothing is
+    // minified
+    const MipPyramid *pyramid;
+
+    // Motion blur samples, each with its own transform
+    A_long numSamples;
+
+    // From output pixels to input pixels
+    Homography::Matrix inverse[MOTION_BLUR_MAX_SAMPLES];
+
+    // Edges of the layer in the output, as e[0] * x + e[1] * y + e[2] giving
+    // the signed distance in output pixels, positive inside
+    double edges[MOTION_BLUR_MAX_SAMPLES][4][3];
+};
+
+// Set the transform of the motion blur sample k, as the inverse from output
+// world pixels to input world pixels, along with the edges of the layer,
+// given in input world pixels. Affine transforms have their projective row
+// made exact, as affine rows are sampled without dividing by w.
+inline void SetWarpSample(WarpRefcon *refcon, A_long k, const Homography::Matrix &inverse,
+                          double left, double top, double right, double bottom) {
+    refcon->inverse[k] = inverse;
+
+    if (refcon->affine) {
+        refcon->inverse[k].m[2][0] = refcon->inverse[k].m[2][1] = 0;
+        refcon->inverse[k].m[2][2] = 1;
+    }
+
+    // Each edge of the layer is a line in the output: u >= left, for
+    // instance, is row 0 - left * row 2 >= 0 in homogeneous coordinates.
+    // They are scaled to give distances in output pixels.
+    const double(*m)[3] = refcon->inverse[k].m;
+    double(*edges)[3] = refcon->edges[k];
+
+    for (int j = 0; j < 3; j++) {
+        edges[0][j] = m[0][j] - left * m[2][j];
+        edges[1][j] = right * m[2][j] - m[0][j];
+        edges[2][j] = m[1][j] - top * m[2][j];
+        edges[3][j] = bottom * m[2][j] - m[1][j];
+    }
+
+    for (int i = 0; i < 4; i++) {
+        double *e = edges[i];
+        double norm = std::sqrt(e[0] * e[0] + e[1] * e[1]);
+
+        if (norm > 0) {
+            e[0] /= norm;
+            e[1] /= norm;
+            e[2] /= norm;
+        }
+    }
+}
+
+// Where a warped row goes: straight to the output, or weighted into the
+// accumulation of motion blur samples, to which transparent pixels add
+// nothing
+template <typename PixelType>
+struct RowWriter {
+    PixelType *dstP;
+
+    void clear(A_long start, A_long end) const {
+        std::memset(dstP + start, 0, (end - start) * sizeof(PixelType));
+    }
+
+    void writePixel(A_long x, const PixelType &pixel) const {
+        dstP[x] = pixel;
+    }
+};
+
+struct RowAccumulator {
+    PF_PixelFloat *accumP;
+    float weight;
+
+    void clear(A_long start, A_long end) const {}
+
+    void write(A_long x, const PF_PixelFloat &color) const {
+        accumP[x].alpha += color.alpha * weight;
+        accumP[x].red += color.red * weight;
+        accumP[x].green += color.green * weight;
+        accumP[x].blue += color.blue * weight;
+    }
+
+    template <typename PixelType>
+    void writePixel(A_long x, const PixelType &pixel) const {
+        this->write(x, PixelSampler::toFloat(pixel));
+    }
+};
+
+// Narrow [start, end) to the pixels x where d0 + dx * x is at least t
+inline void ClipSpan(double d0, double dx, double t, A_long *start,
+                     A_long *end) {
+    if (dx == 0) {
+        if (d0 < t) {
+            *end = *start;
+        }
+        return;
+    }
+
+    double x = std::min(std::max((t - d0) / dx, -1.0), (double)*end + 1);
+
+    if (dx > 0) {
+        *start = std::max(*start, (A_long)std::ceil(x));
+    } else {
+        *end = std::min(*end, (A_long)std::floor(x) + 1);
+    }
+}
+
+// Inverse map a row of the output. The edges of the layer give the span of
+// pixels it touches, outside of which the row is cleared without sampling,
+// and the span it covers fully. Pixels in between are weighted by their
+// coverage, estimated from the distance to each edge.
+//
+// The homogeneous source coordinates move by the first column of the matrix
+// from one pixel to the next, so each pixel costs three adds and one
+// reciprocal before sampling, and affine transforms skip the reciprocal too.
+// Where the input is minified, the derivatives of the source position give
+// the footprint of the pixel to filter the pyramid with.
+template <typename PixelType, bool Affine, typename Writer>
+void WarpRow(const WarpRefcon *refcon, A_long k, A_long y,
+                    const Writer &out) {
+    const PF_EffectWorld *input_worldP = refcon->input_worldP;
+    PF_EffectWorld *output_worldP = refcon->output_worldP;
+    const double(*m)[3] = refcon->inverse[k].m;
+
+    double cy = y + 0.5;
+
+    // Distances to the edges at the first pixel, and their step
+    double d0[4], dx[4];
+    A_long touchStart = 0, touchEnd = output_worldP->width;
+    A_long fullStart = 0, fullEnd = output_worldP->width;
+
+    for (int i = 0; i < 4; i++) {
+        const double *e = refcon->edges[k][i];
+        d0[i] = e[0] * 0.5 + e[1] * cy + e[2];
+        dx[i] = e[0];
+
+        ClipSpan(d0[i], dx[i], -0.5, &touchStart, &touchEnd);
+        ClipSpan(d0[i], dx[i], 0.5, &fullStart, &fullEnd);
+    }
+
+    if (touchStart >= touchEnd) {
+        out.clear(0, output_worldP->width);
+        return;
+    }
+
+    out.clear(0, touchStart);
+    out.clear(touchEnd, output_worldP->width);
+
+    double cx = touchStart + 0.5;
+    double hx = m[0][0] * cx + m[0][1] * cy + m[0][2];
+    double hy = m[1][0] * cx + m[1][1] * cy + m[1][2];
+    double hw = m[2][0] * cx + m[2][1] * cy + m[2][2];
+
+    for (A_long x = touchStart; x < touchEnd;
+         x++, hx += m[0][0], hy += m[1][0], hw += m[2][0]) {
+        // Behind the horizon
+        if (!Affine && hw <= 0) {
+            out.clear(x, x + 1);
+            continue;
+        }
+
+        float coverage = 1;
+
+        if (x < fullStart || x >= fullEnd) {
+            for (int i = 0; i < 4; i++) {
+                double d = d0[i] + dx[i] * x;
+
+                // Edges stay hard in draft quality, like the GL path
+                coverage *= refcon->nearest
+                                ? (d >= 0 ? 1.0f : 0.0f)
+                                : (float)std::min(std::max(d + 0.5, 0.0), 1.0);
+            }
+
+            if (coverage <= 0) {
+                out.clear(x, x + 1);
+                continue;
+            }
+        }
+
+        double w = Affine ? 1.0 : 1 / hw;
+        float u = (float)(hx * w), v = (float)(hy * w);
+
+        // Pixels are sampled and covered in the depth of the layer
+        PixelType pixel;
+
+        if (refcon->nearest) {
+            pixel = PixelSampler::sampleNearestPixel<PixelType>(input_worldP, u, v);
+        } else if (refcon->pyramid) {
+            float dudx = (float)((m[0][0] - hx * w * m[2][0]) * w);
+            float dvdx = (float)((m[1][0] - hy * w * m[2][0]) * w);
+            float dudy = (float)((m[0][1] - hx * w * m[2][1]) * w);
+            float dvdy = (float)((m[1][1] - hy * w * m[2][1]) * w);
+
+            pixel = refcon->pyramid->sampleAnisotropicFixed<PixelType>(
+                u, v, dudx, dvdx, dudy, dvdy);
+        } else {
+            pixel = PixelSampler::sampleBilinearFixed<PixelType>(input_worldP, u, v);
+        }
+
+        if (coverage < 1) {
+            pixel = PixelSampler::scalePixel(pixel, coverage);
+        }
+
+        out.writePixel(x, pixel);
+    }
+}
+
+template <typename PixelType, typename Writer>
+void WarpRow(const WarpRefcon *refcon, A_long k, A_long y,
+                    const Writer &out) {
+    if (refcon->affine) {
+        WarpRow<PixelType, true>(refcon, k, y, out);
+    } else {
+        WarpRow<PixelType, false>(refcon, k, y, out);
+    }
+}
+
+// Warp the rows [yStart, yEnd). Motion blur samples of a row are added up in
+// float, then written once.
+template <typename PixelType>
+void WarpRows(const WarpRefcon *refcon, A_long yStart, A_long yEnd) {
+    PF_EffectWorld *output_worldP = refcon->output_worldP;
+    std::vector<PF_PixelFloat> accum(refcon->numSamples > 1 ? output_worldP->width : 0);
+
+    for (A_long y = yStart; y < yEnd; y++) {
+        PixelType *dstP = reinterpret_cast<PixelType *>(
+            (char *)output_worldP->data + y * output_worldP->rowbytes);
+
+        if (refcon->numSamples == 1) {
+            WarpRow<PixelType>(refcon, 0, y, RowWriter<PixelType>{dstP});
+            continue;
+        }
+
+        std::fill(accum.begin(), accum.end(), PF_PixelFloat{0, 0, 0, 0});
+        RowAccumulator accumulator = {accum.data(), 1.0f / refcon->numSamples};
+
+        for (A_long k = 0; k < refcon->numSamples; k++) {
+            WarpRow<PixelType>(refcon, k, y, accumulator);
+        }
+
+        for (A_long x = 0; x < output_worldP->width; x++) {
+            PixelSampler::fromFloat(accum[x], &dstP[x]);
+        }
+    }
+}
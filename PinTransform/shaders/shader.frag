@@ -1,26 +1,21 @@
 #version 400
 
 uniform sampler2D tex0;
+
+// Layer pixels, from the output back to the input
 uniform mat3 xformInv;
-uniform vec2 resolution;
 
-in vec2 uv;
+uniform vec2 inputOrigin;
+uniform vec2 inputSize;
+
+// Output position in layer pixels. It is linear in screen space, so the
+// interpolation is exact even under perspective.
+in vec2 coord;
 out vec4 fragColor;
 
 void main() {
-    // https://stackoverflow.com/a/42103766
-    vec3 coord = vec3(uv.x * resolution.x,
-                      (1.0 - uv.y) * resolution.y, 1.0);
-    
-    vec3 m = vec3(xformInv[0][2], xformInv[1][2], xformInv[2][2]) * coord;
-    float zed = 1.0 / (m.x + m.y + m.z);
-    coord *= zed;
-
-    float x = xformInv[0][0] * coord.x + xformInv[1][0] * coord.y + xformInv[2][0] * coord.z;
-    float y = xformInv[0][1] * coord.x + xformInv[1][1] * coord.y + xformInv[2][1] * coord.z;
+    vec3 src = xformInv * vec3(coord, 1.0);
+    vec2 uv = (src.xy / src.z - inputOrigin) / inputSize;
 
-    // Normalize back to texture space
-    vec2 newUv = vec2(x / resolution.x, 1.0 - y / resolution.y);
-    
-    fragColor = texture(tex0, newUv);
+    fragColor = texture(tex0, vec2(uv.x, 1.0 - uv.y));
 }
@@ -1,22 +1,25 @@
 #version 400
 
-uniform vec2 resolution;
+// Layer pixels, from the input to the output
 uniform mat3 xform;
 
+// Rects of the input texture and the output in layer pixels
+uniform vec2 inputOrigin;
+uniform vec2 inputSize;
+uniform vec2 outputOrigin;
+uniform vec2 outputSize;
+
 in vec2 aPos;
-out vec2 uv;
+out vec2 coord;
 
 void main() {
-    // Convert to pixel coordinate
-    vec2 coord = vec2(aPos.x * resolution.x, (1.0 - aPos.y) * resolution.y);
-    
-    vec3 newCoord3D = xform * vec3(coord, 1.0);
-    vec2 newCoord = newCoord3D.xy / newCoord3D.z;
-    
-    // Convert back to UV space
-    vec2 newPos = vec2(newCoord.x / resolution.x, 1.0 - newCoord.y / resolution.y);
-    
-    // Assign 'em to output
-    gl_Position = vec4(newPos * 2.0 - 1.0, 0.0, 1.0);
-    uv = newPos;
+    // The quad covers the input, which is uploaded upside down
+    vec2 src = inputOrigin + vec2(aPos.x, 1.0 - aPos.y) * inputSize;
+
+    vec3 dst = xform * vec3(src, 1.0);
+    coord = dst.xy / dst.z;
+
+    // Convert to clip space of the output, flipped back for the readback
+    vec2 pos = (coord - outputOrigin) / outputSize;
+    gl_Position = vec4(pos.x * 2.0 - 1.0, 1.0 - pos.y * 2.0, 0.0, 1.0);
 }
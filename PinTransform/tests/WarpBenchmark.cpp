@@ -0,0 +1,504 @@
+// Time of the CPU and the GL paths of PinTransform per frame, at each depth
+// and a few frame sizes, to set CPU_WARP_MAX_PIXELS from.
+//
+// The CPU path runs WarpRows, the very rows SmartRender warps, over bands of
+// WARP_BAND_ROWS spread across every hardware thread, as iterate_generic
+// does. The GL path replays the calls SmartRender makes with the shaders of
+// the effect: the flipped copy into the staging buffer, the upload and the
+// mipmaps, the draw, the readback and the flipped copy out. It is timed
+// both with the upload, as when the layer changes every frame, and without,
+// as when the texture cache holds the layer already.
+//
+// The layer is warped by a rotation, a slight magnification and a slight
+// perspective, so that nothing is minified and no pyramid is built. Each
+// timing is the median of several frames after a warm-up one.
+//
+// CPU_WARP_MAX_PIXELS is to be set to the largest frame measured here that
+// the CPU warps at least as fast as GL with the upload, at every depth, on
+// the GPUs the effect targets. Software rasterizers favor the CPU and don't
+// count.
+//
+//     make -C PinTransform/tests run
+
+#include "AEConfig.h"
+
+#include "../WarpRows.hpp"
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#include <OpenGL/gl3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Least number of frames timed per measurement, and least time spent on it
+#define MIN_FRAMES 5
+#define MIN_SECONDS 1.0
+
+#define SHADER_DIR "../shaders/"
+
+struct Depth {
+    const char *name;
+    PF_PixelFormat format;
+    size_t pixelBytes;
+    GLenum pixelType;
+    GLenum internalFormat;
+};
+
+static const Depth DEPTHS[] = {
+    {"8bpc", PF_PixelFormat_ARGB32, sizeof(PF_Pixel8), GL_UNSIGNED_BYTE, GL_RGBA8},
+    {"16bpc", PF_PixelFormat_ARGB64, sizeof(PF_Pixel16), GL_UNSIGNED_SHORT, GL_RGBA16},
+    {"32bpc", PF_PixelFormat_ARGB128, sizeof(PF_PixelFloat), GL_FLOAT, GL_RGBA32F},
+};
+
+static const struct {
+    A_long width, height;
+} SIZES[] = {{512, 512}, {1024, 1024}, {1920, 1080}, {2048, 2048}};
+
+// An effect world of its own pixels
+struct World {
+    std::vector<char> pixels;
+    PF_EffectWorld world;
+
+    World(A_long width, A_long height, size_t pixelBytes) {
+        // Rows padded as AE pads them
+        A_long rowbytes = (A_long)((width * pixelBytes + 15) / 16 * 16);
+        pixels.resize((size_t)rowbytes * height);
+
+        std::memset(&world, 0, sizeof(world));
+        world.data = pixels.data();
+        world.rowbytes = rowbytes;
+        world.width = width;
+        world.height = height;
+    }
+};
+
+static double now() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Median time in milliseconds of a frame rendered by the function
+template <typename Frame>
+static double timeFrames(const Frame &frame) {
+    frame();
+
+    std::vector<double> times;
+    double start = now();
+
+    while ((int)times.size() < MIN_FRAMES || now() - start < MIN_SECONDS) {
+        double t = now();
+        frame();
+        times.push_back((now() - t) * 1000);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Layer pixels, from the input to the output: a rotation and a slight
+// magnification about the center, seen in a slight perspective
+static Homography::Matrix getTransform(A_long width, A_long height) {
+    double c = std::cos(0.25), s = std::sin(0.25), scale = 1.1;
+    double cx = width / 2.0, cy = height / 2.0;
+
+    Homography::Matrix rotate = {
+        {{c * scale, -s * scale, 0}, {s * scale, c * scale, 0}, {0, 0, 1}}};
+    Homography::Matrix perspective = {{{1, 0, 0}, {0, 1, 0}, {0.05 / width, 0, 1}}};
+    Homography::Matrix toCenter = {{{1, 0, -cx}, {0, 1, -cy}, {0, 0, 1}}};
+    Homography::Matrix fromCenter = {{{1, 0, cx}, {0, 1, cy}, {0, 0, 1}}};
+
+    return Homography::multiply(
+        fromCenter,
+        Homography::multiply(perspective, Homography::multiply(rotate, toCenter)));
+}
+
+// Random channels within the range of the depth
+static void fillRandom(World *input, const Depth &depth) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0, 1);
+    PF_EffectWorld *worldP = &input->world;
+
+    for (A_long y = 0; y < worldP->height; y++) {
+        char *rowP = (char *)worldP->data + (size_t)y * worldP->rowbytes;
+
+        for (A_long c = 0; c < worldP->width * 4; c++) {
+            float v = unit(rng);
+
+            switch (depth.format) {
+                case PF_PixelFormat_ARGB32:
+                    reinterpret_cast<A_u_char *>(rowP)[c] = (A_u_char)(v * PF_MAX_CHAN8);
+                    break;
+                case PF_PixelFormat_ARGB64:
+                    reinterpret_cast<A_u_short *>(rowP)[c] = (A_u_short)(v * PF_MAX_CHAN16);
+                    break;
+                case PF_PixelFormat_ARGB128:
+                    reinterpret_cast<PF_FpShort *>(rowP)[c] = v;
+                    break;
+            }
+        }
+    }
+}
+
+// CPU
+
+struct CPUWarp {
+    WarpRefcon refcon;
+    A_long numBands;
+    std::atomic<A_long> nextBand;
+
+    void runBands() {
+        A_long i;
+
+        while ((i = nextBand++) < numBands) {
+            A_long yStart = i * WARP_BAND_ROWS;
+            A_long yEnd = std::min(yStart + WARP_BAND_ROWS, refcon.output_worldP->height);
+
+            switch (refcon.format) {
+                case PF_PixelFormat_ARGB32:
+                    WarpRows<PF_Pixel8>(&refcon, yStart, yEnd);
+                    break;
+                case PF_PixelFormat_ARGB64:
+                    WarpRows<PF_Pixel16>(&refcon, yStart, yEnd);
+                    break;
+                case PF_PixelFormat_ARGB128:
+                    WarpRows<PF_PixelFloat>(&refcon, yStart, yEnd);
+                    break;
+            }
+        }
+    }
+};
+
+static double timeCPU(const Depth &depth, World *input, World *output, bool affine) {
+    Homography::Matrix mat = getTransform(input->world.width, input->world.height);
+    if (affine) {
+        mat.m[2][0] = mat.m[2][1] = 0;
+    }
+
+    Homography::Matrix inverse = {};
+    Homography::invert(mat, &inverse);
+
+    CPUWarp warp;
+    warp.refcon.in_data = nullptr;
+    warp.refcon.input_worldP = &input->world;
+    warp.refcon.output_worldP = &output->world;
+    warp.refcon.format = depth.format;
+    warp.refcon.nearest = false;
+    warp.refcon.affine = affine;
+    warp.refcon.pyramid = nullptr;
+    warp.refcon.numSamples = 1;
+    SetWarpSample(&warp.refcon, 0, inverse, 0, 0, input->world.width,
+                  input->world.height);
+    warp.numBands = (output->world.height + WARP_BAND_ROWS - 1) / WARP_BAND_ROWS;
+
+    unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    return timeFrames([&]() {
+        warp.nextBand = 0;
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < numThreads; t++) {
+            threads.emplace_back([&]() { warp.runBands(); });
+        }
+
+        warp.runBands();
+
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    });
+}
+
+// GL
+
+static bool createContext() {
+#ifdef __APPLE__
+    CGLPixelFormatAttribute attributes[] = {
+        kCGLPFAOpenGLProfile, (CGLPixelFormatAttribute)kCGLOGLPVersion_GL4_Core,
+        kCGLPFAAccelerated, (CGLPixelFormatAttribute)0};
+    CGLPixelFormatObj pixelFormat;
+    GLint numFormats;
+    CGLContextObj context;
+
+    if (CGLChoosePixelFormat(attributes, &pixelFormat, &numFormats) != kCGLNoError ||
+        !pixelFormat || CGLCreateContext(pixelFormat, nullptr, &context) != kCGLNoError) {
+        return false;
+    }
+
+    CGLDestroyPixelFormat(pixelFormat);
+    return CGLSetCurrentContext(context) == kCGLNoError;
+#else
+    // Headless, with nothing drawn but to framebuffer objects
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (!eglInitialize(display, nullptr, nullptr)) {
+        display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                                        nullptr);
+
+        if (!eglInitialize(display, nullptr, nullptr)) {
+            return false;
+        }
+    }
+
+    // No config is needed without a surface, where the display has none
+    EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint numConfigs = 0;
+
+    eglChooseConfig(display, configAttributes, &config, 1, &numConfigs);
+
+    if (!numConfigs) {
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        return false;
+    }
+
+    EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 1,
+                                  EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                  EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+    EGLContext context =
+        eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+
+    return context != EGL_NO_CONTEXT &&
+           eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+#endif
+}
+
+static GLuint compileShader(GLenum type, const char *path) {
+    std::ifstream file(path);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string code = stream.str();
+    const char *codeP = code.c_str();
+
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &codeP, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::fprintf(stderr, "Couldn't compile %s:\n%s\n", path, log);
+    }
+
+    return shader;
+}
+
+// The program and the quad of the effect, set up once as in GlobalSetup
+struct GLScene {
+    GLuint program, quad, vao;
+
+    GLScene() {
+        program = glCreateProgram();
+        glAttachShader(program, compileShader(GL_VERTEX_SHADER, SHADER_DIR "shader.vert"));
+        glAttachShader(program,
+                       compileShader(GL_FRAGMENT_SHADER, SHADER_DIR "shader.frag"));
+        glBindAttribLocation(program, 0, "aPos");
+        glLinkProgram(program);
+
+        const float vertices[] = {0, 0, 1, 0, 0, 1, 1, 1};
+        glGenBuffers(1, &quad);
+        glBindBuffer(GL_ARRAY_BUFFER, quad);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+        glBindVertexArray(0);
+    }
+};
+
+// Flipped copies between an effect world and the packed rows of GL, as in
+// AEOGLInterop::uploadTexture and downloadTexture
+static void copyToGL(const PF_EffectWorld *worldP, size_t pixelBytes, char *glP) {
+    for (A_long y = 0; y < worldP->height; y++) {
+        std::memcpy(glP + (size_t)(worldP->height - y - 1) * worldP->width * pixelBytes,
+                    (const char *)worldP->data + (size_t)y * worldP->rowbytes,
+                    worldP->width * pixelBytes);
+    }
+}
+
+static void copyFromGL(const char *glP, size_t pixelBytes, PF_EffectWorld *worldP) {
+    for (A_long y = 0; y < worldP->height; y++) {
+        std::memcpy((char *)worldP->data + (size_t)y * worldP->rowbytes,
+                    glP + (size_t)(worldP->height - y - 1) * worldP->width * pixelBytes,
+                    worldP->width * pixelBytes);
+    }
+}
+
+static double timeGL(const GLScene &scene, const Depth &depth, World *input,
+                     World *output, bool upload, bool draw) {
+    GLsizei width = output->world.width, height = output->world.height;
+    std::vector<char> buffer(std::max((size_t)width * height,
+                                      (size_t)input->world.width * input->world.height) *
+                             depth.pixelBytes);
+
+    GLuint texture, fbo, rbo;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, depth.internalFormat, input->world.width,
+                 input->world.height, 0, GL_RGBA, depth.pixelType, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, depth.internalFormat, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::fprintf(stderr, "Incomplete framebuffer at %s\n", depth.name);
+    }
+
+    // Row-major floats, as glm holds ParamInfo::xform transposed
+    Homography::Matrix mat = getTransform(input->world.width, input->world.height);
+    Homography::Matrix inverse = {};
+    Homography::invert(mat, &inverse);
+
+    float xform[9], xformInv[9];
+    for (int i = 0; i < 9; i++) {
+        xform[i] = (float)mat.m[i / 3][i % 3];
+        xformInv[i] = (float)inverse.m[i / 3][i % 3];
+    }
+
+    // The texture starts out filled, for the frames without the upload
+    copyToGL(&input->world, depth.pixelBytes, buffer.data());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, input->world.width, input->world.height,
+                    GL_RGBA, depth.pixelType, buffer.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    double ms = timeFrames([&]() {
+        if (upload) {
+            copyToGL(&input->world, depth.pixelBytes, buffer.data());
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, input->world.width,
+                            input->world.height, GL_RGBA, depth.pixelType, buffer.data());
+
+            if (draw) {
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
+
+        glUseProgram(scene.program);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, width, height);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glUniform1i(glGetUniformLocation(scene.program, "tex0"), 0);
+        glUniform2f(glGetUniformLocation(scene.program, "inputOrigin"), 0, 0);
+        glUniform2f(glGetUniformLocation(scene.program, "inputSize"),
+                    (float)input->world.width, (float)input->world.height);
+        glUniform2f(glGetUniformLocation(scene.program, "outputOrigin"), 0, 0);
+        glUniform2f(glGetUniformLocation(scene.program, "outputSize"), (float)width,
+                    (float)height);
+        glUniformMatrix3fv(glGetUniformLocation(scene.program, "xform"), 1, GL_TRUE, xform);
+        glUniformMatrix3fv(glGetUniformLocation(scene.program, "xformInv"), 1, GL_TRUE,
+                           xformInv);
+
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (draw) {
+            glBindVertexArray(scene.vao);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            glBindVertexArray(0);
+        }
+
+        glReadPixels(0, 0, width, height, GL_RGBA, depth.pixelType, buffer.data());
+        copyFromGL(buffer.data(), depth.pixelBytes, &output->world);
+
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    });
+
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo);
+    glDeleteTextures(1, &texture);
+
+    return ms;
+}
+
+int main() {
+    if (!createContext()) {
+        std::fprintf(stderr, "Couldn't create a GL 4.1 core context\n");
+        return 1;
+    }
+
+    GLScene scene;
+
+    std::printf("GL: %s, %s\n", (const char *)glGetString(GL_RENDERER),
+                (const char *)glGetString(GL_VERSION));
+    std::printf("CPU: %u threads\n\n", std::max(std::thread::hardware_concurrency(), 1u));
+    std::printf("Median time per frame in ms\n\n");
+    std::printf("%-6s %11s %12s %12s %10s %14s %14s\n", "Depth", "Size", "CPU affine",
+                "CPU persp.", "GL", "GL (cached)", "GL transfers");
+
+    // Largest frame the CPU warps at least as fast as GL, per depth
+    double maxPixels[3] = {0, 0, 0};
+    bool cpuAhead[3] = {true, true, true};
+
+    for (int d = 0; d < 3; d++) {
+        const Depth &depth = DEPTHS[d];
+
+        for (const auto &size : SIZES) {
+            World input(size.width, size.height, depth.pixelBytes);
+            World output(size.width, size.height, depth.pixelBytes);
+            fillRandom(&input, depth);
+
+            double cpuAffine = timeCPU(depth, &input, &output, true);
+            double cpuPerspective = timeCPU(depth, &input, &output, false);
+            double gl = timeGL(scene, depth, &input, &output, true, true);
+            double glCached = timeGL(scene, depth, &input, &output, false, true);
+            double glTransfers = timeGL(scene, depth, &input, &output, true, false);
+
+            char sizeName[32];
+            std::snprintf(sizeName, sizeof(sizeName), "%dx%d", size.width, size.height);
+            std::printf("%-6s %11s %12.2f %12.2f %10.2f %14.2f %14.2f\n", depth.name,
+                        sizeName, cpuAffine, cpuPerspective, gl, glCached, glTransfers);
+
+            cpuAhead[d] &= cpuPerspective <= gl;
+            if (cpuAhead[d]) {
+                maxPixels[d] = (double)size.width * size.height;
+            }
+        }
+    }
+
+    double pixels = *std::min_element(maxPixels, maxPixels + 3);
+    std::printf("\nCPU_WARP_MAX_PIXELS %.0f", pixels);
+
+    if (pixels == 0) {
+        std::printf(" (GL is faster at every size measured)\n");
+    } else if (cpuAhead[0] && cpuAhead[1] && cpuAhead[2]) {
+        std::printf(" (the CPU is as fast at every size measured)\n");
+    } else {
+        std::printf("\n");
+    }
+
+    return 0;
+}
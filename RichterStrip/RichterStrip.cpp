@@ -9,6 +9,10 @@
 #include "../Debug.h"
 #include "Settings.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 static PF_Err About(PF_InData *in_data, PF_OutData *out_data,
                     PF_ParamDef *params[], PF_LayerDef *output) {
     AEGP_SuiteHandler suites(in_data->pica_basicP);
@@ -35,40 +39,6 @@ static PF_Err GlobalSetup(PF_InData *in_data, PF_OutData *out_data,
     out_data->out_flags2 =
         PF_OutFlag2_FLOAT_COLOR_AWARE | PF_OutFlag2_SUPPORTS_SMART_RENDER;
 
-    // Initialize globalData
-    auto handleSuite = suites.HandleSuite1();
-    PF_Handle globalDataH = handleSuite->host_new_handle(sizeof(GlobalData));
-
-    if (!globalDataH) {
-        return PF_Err_OUT_OF_MEMORY;
-    }
-
-    out_data->global_data = globalDataH;
-
-    GlobalData *globalData = reinterpret_cast<GlobalData *>(
-        handleSuite->host_lock_handle(globalDataH));
-
-    // Initialize global OpenGL context
-    globalData->globalContext = *new OGL::GlobalContext();
-    if (!globalData->globalContext.initialized) {
-        err = PF_Err_OUT_OF_MEMORY;
-    }
-    
-    if (err == PF_Err_NONE) {
-        globalData->globalContext.bind();
-
-        // Setup GL objects
-        globalData->inputTexture = *new OGL::Texture();
-        globalData->fbo = *new OGL::Fbo();
-        globalData->quad = *new OGL::QuadVao();
-
-        std::string resourcePath = AEUtils::getResourcesPath(in_data);
-        std::string vertPath = resourcePath + "shaders/shader.vert";
-        std::string fragPath = resourcePath + "shaders/shader.frag";
-        globalData->program = *new OGL::Shader(vertPath.c_str(), fragPath.c_str());
-    }
-
-    handleSuite->host_unlock_handle(globalDataH);
     return err;
 }
 
@@ -86,102 +56,699 @@ static PF_Err ParamsSetup(PF_InData *in_data, PF_OutData *out_data,
     AEFX_CLR_STRUCT(def);
     PF_ADD_ANGLE("Angle", 0, PARAM_ANGLE);
 
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_FLOAT_SLIDER("Sample Width",       // NAME
+                        0,                    // VALID_MIN,
+                        1000,                 // VALID_MAX
+                        0,                    // SLIDER_MIN
+                        100,                  // SLIDER_MAX
+                        0,                    // CURVE_TORELANCE
+                        0,                    // DFLT
+                        1,                    // PREC
+                        0,                    // DISP
+                        0,                    // WANT_PHASE
+                        PARAM_SAMPLE_WIDTH);  // ID
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_POPUP("Filter",
+                 2,
+                 FILTER_BOX,
+                 "Box|Gaussian",
+                 PARAM_FILTER);
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_POPUP("Layout",
+                 3,
+                 LAYOUT_SINGLE,
+                 "Single|Parallel|Fan",
+                 PARAM_LAYOUT);
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_SLIDER("Count",
+                  1,
+                  STRIP_MAX_LINES,
+                  1,
+                  16,
+                  3,
+                  PARAM_COUNT);
+
+    AEFX_CLR_STRUCT(def);
+    PF_ADD_FLOAT_SLIDER("Spacing",       // NAME
+                        1,               // VALID_MIN,
+                        10000,           // VALID_MAX
+                        1,               // SLIDER_MIN
+                        1000,            // SLIDER_MAX
+                        0,               // CURVE_TORELANCE
+                        100,             // DFLT
+                        1,               // PREC
+                        0,               // DISP
+                        0,               // WANT_PHASE
+                        PARAM_SPACING);  // ID
+
     out_data->num_params = PARAM_NUM_PARAMS;
 
     return err;
 }
 
-static PF_Err GlobalSetdown(PF_InData *in_data, PF_OutData *out_data,
-                            PF_ParamDef *params[], PF_LayerDef *output) {
-    PF_Err err = PF_Err_NONE;
-    AEGP_SuiteHandler suites(in_data->pica_basicP);
+// Point of the sample at the index along the line, in layer pixels
+static void GetSamplePoint(const StripLayout *strip, const StripLine *line,
+                           A_long i, float *x, float *y) {
+    float l = line->start + strip->step * i;
+    *x = line->centerX + line->dirX * l;
+    *y = line->centerY + line->dirY * l;
+}
 
-    // Dispose globalData
-    auto *globalData = reinterpret_cast<GlobalData *>(
-        suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+static float ClampX(const PF_LRect *rect, float x) {
+    return std::min(std::max(x, rect->left + 0.5f), rect->right - 0.5f);
+}
 
-    // Explicitly call deconstructor
-    globalData->inputTexture.~Texture();
-    globalData->program.~Shader();
-    globalData->fbo.~Fbo();
-    globalData->quad.~QuadVao();
-    globalData->globalContext.~GlobalContext();
+static float ClampY(const PF_LRect *rect, float y) {
+    return std::min(std::max(y, rect->top + 0.5f), rect->bottom - 0.5f);
+}
 
-    suites.HandleSuite1()->host_dispose_handle(in_data->global_data);
+// Input rect read by the samples [first, end) of the line. Clamping is
+// monotonic on each axis, so the bounds of the clamped points of a straight
+// run are the clamped bounds of its end points. The filter reaches half its
+// width along the normal on both sides.
+static void GetFootprint(const StripLayout *strip, const StripLine *line,
+                         A_long first, A_long end, const PF_LRect *layerRect,
+                         PF_LRect *rect) {
+    float x0, y0, x1, y1;
+    GetSamplePoint(strip, line, first, &x0, &y0);
+    GetSamplePoint(strip, line, end - 1, &x1, &y1);
+
+    float reachX = strip->width / 2 * std::abs(line->dirY);
+    float reachY = strip->width / 2 * std::abs(line->dirX);
+
+    // Bilinear taps of the bounds, plus a pixel against rounding
+    rect->left = (A_long)std::floor(ClampX(layerRect, std::min(x0, x1) - reachX) - 0.5f);
+    rect->top = (A_long)std::floor(ClampY(layerRect, std::min(y0, y1) - reachY) - 0.5f);
+    rect->right = (A_long)std::floor(ClampX(layerRect, std::max(x0, x1) + reachX) - 0.5f) + 2;
+    rect->bottom = (A_long)std::floor(ClampY(layerRect, std::max(y0, y1) + reachY) - 0.5f) + 2;
+    AEUtils::growRect(rect, 1, 1);
+    AEUtils::intersectRect(layerRect, rect);
+}
 
-    return err;
+struct StripParams {
+    A_FloatPoint center;  // In layer pixels at full resolution
+    A_FpLong angle;       // In degrees
+    A_FpLong sampleWidth, spacing;
+    A_long filter, layout, count;
+};
+
+// Params read into StripParams on every PreRender
+static constexpr ParamSchema::Entry PARAM_SCHEMA[] = {
+    ParamSchema::point(PARAM_CENTER, ParamSchema::AE_SPACE,
+                       PARAM_FIELD(StripParams, center)),
+    ParamSchema::angle(PARAM_ANGLE, ParamSchema::AE_SPACE,
+                       PARAM_FIELD(StripParams, angle)),
+    ParamSchema::floatSlider(PARAM_SAMPLE_WIDTH, PARAM_FIELD(StripParams, sampleWidth)),
+    ParamSchema::popup(PARAM_FILTER, PARAM_FIELD(StripParams, filter)),
+    ParamSchema::popup(PARAM_LAYOUT, PARAM_FIELD(StripParams, layout)),
+    ParamSchema::slider(PARAM_COUNT, PARAM_FIELD(StripParams, count)),
+    ParamSchema::floatSlider(PARAM_SPACING, PARAM_FIELD(StripParams, spacing)),
+};
+
+// Lay out the lines over the span the output rect projects to, and split
+// them into pieces whose input rects cover the filter footprint of their
+// samples. Samples off the layer read its edges, as the samplers clamp.
+static void LayoutStrip(PF_InData *in_data, const StripParams *params,
+                        const PF_LRect *outputRect, const PF_LRect *layerRect,
+                        StripLayout *strip) {
+    float downsampleX = (float)in_data->downsample_x.num / in_data->downsample_x.den;
+    float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
+
+    float angle = params->angle * PI / 180.0f;
+
+    strip->mode = params->layout;
+    strip->centerX = params->center.x * downsampleX;
+    strip->centerY = params->center.y * downsampleY;
+    strip->dirX = std::cos(angle);
+    strip->dirY = std::sin(angle);
+    strip->spacing = params->spacing * downsampleX;
+
+    // In draft quality, sample the strip only at every few pixels along
+    // the line and skip bilinear filtering
+    strip->step = AEUtils::isDraftQuality(in_data) ? DRAFT_SAMPLE_STRIDE : 1.0f;
+
+    strip->width = params->sampleWidth * downsampleX;
+    strip->filter = params->filter;
+
+    strip->numLines = 0;
+    strip->numSamples = 0;
+    strip->numPieces = 0;
+
+    if (AEUtils::isEmptyRect(outputRect)) {
+        return;
+    }
+
+    // The span of the lines the output corners project to, or for rays the
+    // farthest corner. It is aligned to the step, so that draft samples stay
+    // fixed relative to the center.
+    float minL = 0, maxL = 0, maxR = 0;
+
+    for (int corner = 0; corner < 4; corner++) {
+        float x = (corner % 2 == 0 ? outputRect->left : outputRect->right) +
+                  (corner % 2 == 0 ? 0.5f : -0.5f);
+        float y = (corner / 2 == 0 ? outputRect->top : outputRect->bottom) +
+                  (corner / 2 == 0 ? 0.5f : -0.5f);
+        float dx = x - strip->centerX, dy = y - strip->centerY;
+        float l = dx * strip->dirX + dy * strip->dirY;
+
+        minL = corner == 0 ? l : std::min(minL, l);
+        maxL = corner == 0 ? l : std::max(maxL, l);
+        maxR = std::max(maxR, std::sqrt(dx * dx + dy * dy));
+    }
+
+    if (strip->mode == LAYOUT_FAN) {
+        minL = 0;
+        maxL = maxR;
+    }
+
+    float start = std::floor(minL / strip->step) * strip->step;
+    A_long numSamples = (A_long)std::ceil((maxL - start) / strip->step) + 2;
+
+    strip->numLines = strip->mode == LAYOUT_SINGLE
+                          ? 1
+                          : std::min(std::max(params->count, (A_long)1),
+                                     (A_long)STRIP_MAX_LINES);
+
+    for (A_long k = 0; k < strip->numLines; k++) {
+        StripLine *line = &strip->lines[k];
+        line->centerX = strip->centerX;
+        line->centerY = strip->centerY;
+        line->dirX = strip->dirX;
+        line->dirY = strip->dirY;
+
+        if (strip->mode == LAYOUT_PARALLEL) {
+            float offset = (k - (strip->numLines - 1) / 2.0f) * strip->spacing;
+            line->centerX -= strip->dirY * offset;
+            line->centerY += strip->dirX * offset;
+        } else if (strip->mode == LAYOUT_FAN) {
+            float rayAngle = angle + k * 2 * PI / strip->numLines;
+            line->dirX = std::cos(rayAngle);
+            line->dirY = std::sin(rayAngle);
+        }
+
+        line->start = start;
+        line->firstSample = strip->numSamples;
+        line->numSamples = numSamples;
+        strip->numSamples += numSamples;
+    }
+
+    // Several lines are read through a single checkout of their union
+    if (strip->numLines > 1) {
+        StripPiece *piece = &strip->pieces[0];
+        piece->firstSample = 0;
+        piece->endSample = strip->numSamples;
+
+        for (A_long k = 0; k < strip->numLines; k++) {
+            PF_LRect rect;
+            GetFootprint(strip, &strip->lines[k], 0, numSamples, layerRect, &rect);
+
+            if (k == 0) {
+                piece->inputRect = rect;
+            } else {
+                UnionLRect(&rect, &piece->inputRect);
+            }
+        }
+
+        strip->numPieces = 1;
+        return;
+    }
+
+    // A single line is split along the diagonal
+    const StripLine *line = &strip->lines[0];
+
+    float x0, y0, x1, y1;
+    GetSamplePoint(strip, line, 0, &x0, &y0);
+    GetSamplePoint(strip, line, numSamples - 1, &x1, &y1);
+
+    A_long minorSpan = (A_long)std::min(
+        std::abs(ClampX(layerRect, x1) - ClampX(layerRect, x0)),
+        std::abs(ClampY(layerRect, y1) - ClampY(layerRect, y0)));
+    strip->numPieces = std::min(std::max(minorSpan / STRIP_MIN_PIECE_SPAN, (A_long)1),
+                                std::min((A_long)STRIP_MAX_PIECES, numSamples));
+
+    for (A_long k = 0; k < strip->numPieces; k++) {
+        StripPiece *piece = &strip->pieces[k];
+        piece->firstSample = k * numSamples / strip->numPieces;
+        piece->endSample = (k + 1) * numSamples / strip->numPieces;
+
+        GetFootprint(strip, line, piece->firstSample, piece->endSample,
+                     layerRect, &piece->inputRect);
+    }
 }
 
 static PF_Err PreRender(PF_InData *in_data, PF_OutData *out_data,
                         PF_PreRenderExtra *extra) {
     PF_Err err = PF_Err_NONE;
-    AEGP_SuiteHandler suites(in_data->pica_basicP);
-    auto handleSuite = suites.HandleSuite1();
 
     PF_RenderRequest req = extra->input->output_request;
     PF_CheckoutResult in_result;
 
-    // Create paramInfo
-    PF_Handle paramInfoH = handleSuite->host_new_handle(sizeof(ParamInfo));
+    // Take paramInfo from the pool, which AE gives back once rendered
+    ParamInfo *paramInfo = PreRenderPool<ParamInfo>::acquire();
 
-    if (!paramInfoH) {
+    if (!paramInfo) {
         return PF_Err_OUT_OF_MEMORY;
     }
 
     // Set handler
-    extra->output->pre_render_data = paramInfoH;
+    extra->output->pre_render_data = paramInfo;
+    extra->output->delete_pre_render_data_func = PreRenderPool<ParamInfo>::release;
 
-    ParamInfo *paramInfo = reinterpret_cast<ParamInfo *>(
-        handleSuite->host_lock_handle(paramInfoH));
+    // Assign latest param values
+    StripParams params;
+    AEFX_CLR_STRUCT(params);
 
-    if (!paramInfo) {
-        err = PF_Err_OUT_OF_MEMORY;
+    ERR(ParamSchema::checkout(in_data, out_data, PARAM_SCHEMA, &params));
+
+    // The output fills the layer, whatever part of the input is read
+    float downsampleX = (float)in_data->downsample_x.num / in_data->downsample_x.den;
+    float downsampleY = (float)in_data->downsample_y.num / in_data->downsample_y.den;
+
+    PF_LRect layerRect;
+    layerRect.left = layerRect.top = 0;
+    layerRect.right = (A_long)std::ceil(in_data->width * downsampleX);
+    layerRect.bottom = (A_long)std::ceil(in_data->height * downsampleY);
+
+    paramInfo->outputRect = req.rect;
+    AEUtils::intersectRect(&layerRect, &paramInfo->outputRect);
+    paramInfo->nearest = AEUtils::isDraftQuality(in_data);
+
+    if (!err) {
+        LayoutStrip(in_data, &params, &paramInfo->outputRect, &layerRect,
+                    &paramInfo->strip);
     }
 
-    // Assign latest param values
-    ERR(AEOGLInterop::getPointParam(in_data, out_data, PARAM_CENTER,
-                                    AEOGLInterop::GL_SPACE,
-                                    &paramInfo->center));
+    // Checkout only the input along the lines, one rect per piece. The
+    // returned rects tell where each checked out world sits in the layer.
+    for (A_long k = 0; !err && k < paramInfo->strip.numPieces; k++) {
+        StripPiece *piece = &paramInfo->strip.pieces[k];
 
-    ERR(AEOGLInterop::getAngleParam(in_data, out_data, PARAM_ANGLE,
-                                    AEOGLInterop::GL_SPACE, &paramInfo->angle));
+        PF_RenderRequest pieceReq = req;
+        pieceReq.rect = piece->inputRect;
 
-    handleSuite->host_unlock_handle(paramInfoH);
+        ERR(extra->cb->checkout_layer(in_data->effect_ref, PARAM_INPUT, k,
+                                      &pieceReq, in_data->current_time,
+                                      in_data->time_step, in_data->time_scale,
+                                      &in_result));
 
-    // Checkout input image
-    ERR(extra->cb->checkout_layer(in_data->effect_ref, PARAM_INPUT, PARAM_INPUT,
-                                  &req, in_data->current_time,
-                                  in_data->time_step, in_data->time_scale,
-                                  &in_result));
+        if (!err) {
+            piece->inputRect = in_result.result_rect;
+        }
+    }
 
     // Compute the rect to render
     if (!err) {
-        UnionLRect(&in_result.result_rect, &extra->output->result_rect);
-        UnionLRect(&in_result.max_result_rect, &extra->output->max_result_rect);
+        UnionLRect(&paramInfo->outputRect, &extra->output->result_rect);
+        UnionLRect(&layerRect, &extra->output->max_result_rect);
     }
 
     return err;
 }
 
+// Taps of the filter across the line, spaced by the step of the strip at
+// most so that wide filters stay proportional to the sampling along it. The
+// Gaussian falls to two sigmas at the edges of the width.
+static void GetFilterTaps(const StripLayout *strip, std::vector<StripTap> *taps) {
+    A_long numTaps = std::max((A_long)std::ceil(strip->width / strip->step), (A_long)1);
+    float spacing = strip->width / numTaps;
+    float sigma = strip->width / 4;
+    float sum = 0;
+
+    taps->resize(numTaps);
+
+    for (A_long j = 0; j < numTaps; j++) {
+        StripTap &tap = (*taps)[j];
+        tap.offset = (j + 0.5f) * spacing - strip->width / 2;
+        tap.weight = strip->filter == FILTER_GAUSSIAN && numTaps > 1
+                         ? std::exp(-tap.offset * tap.offset / (2 * sigma * sigma))
+                         : 1.0f;
+        sum += tap.weight;
+    }
+
+    // The fixed point weights are differences of the rounded running sum, so
+    // that they add up to one exactly
+    float cumulative = 0;
+    int fixedCumulative = 0;
+
+    for (StripTap &tap : *taps) {
+        tap.weight /= sum;
+        cumulative += tap.weight;
+
+        int next = std::min((int)(cumulative * FIXED_WEIGHT_ONE + 0.5f), FIXED_WEIGHT_ONE);
+        tap.fixedWeight = next - fixedCumulative;
+        fixedCumulative = next;
+    }
+
+    taps->back().fixedWeight += FIXED_WEIGHT_ONE - fixedCumulative;
+}
+
+// Weighted sum of the taps of a sample in the depth of the layer: in fixed
+// point for 8/16bpc, where the sums of at most PF_MAX_CHAN16 <<
+// FIXED_WEIGHT_BITS fit in 32 bits, and in float for float
+template <typename PixelType>
+struct TapSum {
+    A_long alpha = 0, red = 0, green = 0, blue = 0;
+
+    void add(const PixelType &p, const StripTap &tap) {
+        alpha += p.alpha * tap.fixedWeight;
+        red += p.red * tap.fixedWeight;
+        green += p.green * tap.fixedWeight;
+        blue += p.blue * tap.fixedWeight;
+    }
+
+    PixelType get() const {
+        PixelType p;
+        p.alpha = (alpha + FIXED_WEIGHT_ONE / 2) >> FIXED_WEIGHT_BITS;
+        p.red = (red + FIXED_WEIGHT_ONE / 2) >> FIXED_WEIGHT_BITS;
+        p.green = (green + FIXED_WEIGHT_ONE / 2) >> FIXED_WEIGHT_BITS;
+        p.blue = (blue + FIXED_WEIGHT_ONE / 2) >> FIXED_WEIGHT_BITS;
+        return p;
+    }
+};
+
+template <>
+struct TapSum<PF_PixelFloat> {
+    PF_PixelFloat sum = {0, 0, 0, 0};
+
+    void add(const PF_PixelFloat &p, const StripTap &tap) {
+        sum.alpha += p.alpha * tap.weight;
+        sum.red += p.red * tap.weight;
+        sum.green += p.green * tap.weight;
+        sum.blue += p.blue * tap.weight;
+    }
+
+    PF_PixelFloat get() const {
+        return sum;
+    }
+};
+
+// Sample the input along the lines into a piece of the strip, filtering
+// across them in the depth of the layer, which the output shares. The
+// coordinates are moved from the layer into the checked out world.
+template <typename PixelType>
+static void SampleStrip(const PF_EffectWorld *input_worldP,
+                        const StripLayout *strip, const StripPiece *piece,
+                        const std::vector<StripTap> &taps, bool nearest,
+                        PixelType *samples) {
+    for (A_long k = 0; k < strip->numLines; k++) {
+        const StripLine *line = &strip->lines[k];
+
+        A_long first = std::max(piece->firstSample, line->firstSample);
+        A_long end = std::min(piece->endSample, line->firstSample + line->numSamples);
+
+        for (A_long i = first; i < end; i++) {
+            float x, y;
+            GetSamplePoint(strip, line, i - line->firstSample, &x, &y);
+            x -= piece->inputRect.left;
+            y -= piece->inputRect.top;
+
+            TapSum<PixelType> sum;
+
+            for (const StripTap &tap : taps) {
+                float tx = x - line->dirY * tap.offset;
+                float ty = y + line->dirX * tap.offset;
+
+                sum.add(nearest ? PixelSampler::sampleNearestPixel<PixelType>(
+                                      input_worldP, tx, ty)
+                                : PixelSampler::sampleBilinearFixed<PixelType>(
+                                      input_worldP, tx, ty),
+                        tap);
+            }
+
+            samples[i] = sum.get();
+        }
+    }
+}
+
+// The line a point of the layer takes its color from, and the position along
+// the line it is at
+static const StripLine *LocateOnStrip(const StripLayout *strip, float x,
+                                      float y, float *l) {
+    float dx = x - strip->centerX, dy = y - strip->centerY;
+    A_long k = 0;
+
+    switch (strip->mode) {
+        case LAYOUT_PARALLEL: {
+            float m = -dx * strip->dirY + dy * strip->dirX;
+            k = (A_long)std::floor(m / strip->spacing +
+                                   (strip->numLines - 1) / 2.0f + 0.5f);
+            k = std::min(std::max(k, (A_long)0), strip->numLines - 1);
+            *l = dx * strip->dirX + dy * strip->dirY;
+            break;
+        }
+        case LAYOUT_FAN: {
+            float a = std::atan2(dy, dx) - std::atan2(strip->dirY, strip->dirX);
+            k = (A_long)std::floor(a * strip->numLines / (2 * PI) + 0.5f) %
+                strip->numLines;
+            k = k < 0 ? k + strip->numLines : k;
+            *l = std::sqrt(dx * dx + dy * dy);
+            break;
+        }
+        default:
+            *l = dx * strip->dirX + dy * strip->dirY;
+            break;
+    }
+
+    return &strip->lines[k];
+}
+
+// Positions along a line in samples, in fixed point, as the rows step
+// through them
+typedef int64_t StripPosition;
+
+static StripPosition ToStripPosition(double t) {
+    return (StripPosition)std::llround(t * ((StripPosition)1 << STRIP_POSITION_BITS));
+}
+
+// Color of the line at the position along it, from the strip in the output
+// depth
+template <typename PixelType>
+static PixelType LookupStrip(const PixelType *lineP, A_long numSamples,
+                             StripPosition t, bool nearest) {
+    const StripPosition one = (StripPosition)1 << STRIP_POSITION_BITS;
+    A_long last = numSamples - 1;
+    t = std::min(std::max(t, (StripPosition)0), (StripPosition)last * one);
+
+    if (nearest) {
+        return lineP[(t + one / 2) >> STRIP_POSITION_BITS];
+    }
+
+    A_long i = std::min((A_long)(t >> STRIP_POSITION_BITS), last - 1);
+    int f = (int)((t - (StripPosition)i * one) >>
+                  (STRIP_POSITION_BITS - FIXED_WEIGHT_BITS));
+    return PixelSampler::lerpPixelFixed(lineP[i], lineP[i + 1], f);
+}
+
+// Number of pixels from the position on, up to count, for which the
+// position stays on the same side of the bound, stepping by dt
+static A_long CountUntil(StripPosition t, StripPosition dt, StripPosition bound,
+                         A_long count) {
+    StripPosition distance = dt > 0 ? bound - t : t - bound;
+    StripPosition speed = dt > 0 ? dt : -dt;
+
+    if (distance <= 0) {
+        return 0;
+    }
+    if (speed == 0) {
+        return count;
+    }
+    return (A_long)std::min((distance + speed - 1) / speed, (StripPosition)count);
+}
+
+// Write a span of a row from one line, the position stepping evenly along
+// it. Pixels beyond either end of the line, and runs of the same nearest
+// sample when magnified, are filled, and the others looked up one by one.
+template <typename PixelType>
+static void WriteLineSpan(PixelType *dstP, A_long count, const PixelType *lineP,
+                          A_long numSamples, StripPosition t, StripPosition dt,
+                          bool nearest) {
+    const StripPosition one = (StripPosition)1 << STRIP_POSITION_BITS;
+    StripPosition lastT = (StripPosition)(numSamples - 1) * one;
+
+    if (dt == 0) {
+        std::fill(dstP, dstP + count, LookupStrip(lineP, numSamples, t, nearest));
+        return;
+    }
+
+    A_long x = 0;
+
+    while (x < count) {
+        A_long n;
+
+        if ((t <= 0 && dt < 0) || (t >= lastT && dt > 0)) {
+            // Past the end the position moves towards, to the end of the span
+            n = count - x;
+        } else if (t <= 0 || t >= lastT) {
+            // Before the end the position moves away from
+            n = std::max(CountUntil(t, dt, t <= 0 ? 1 : lastT - 1, count - x), (A_long)1);
+        } else if (nearest && std::abs(dt) * 2 < one) {
+            // Magnified, until the nearest sample changes
+            StripPosition i = (t + one / 2) >> STRIP_POSITION_BITS;
+            StripPosition bound = dt > 0 ? i * one + one / 2 : i * one - one / 2 - 1;
+            n = std::max(CountUntil(t, dt, bound, count - x), (A_long)1);
+        } else {
+            // Within the line, each pixel looked up on its own
+            n = std::max(CountUntil(t, dt, dt > 0 ? lastT : 0, count - x), (A_long)1);
+
+            for (A_long j = 0; j < n; j++, t += dt) {
+                dstP[x + j] = LookupStrip(lineP, numSamples, t, nearest);
+            }
+            x += n;
+            continue;
+        }
+
+        std::fill(dstP + x, dstP + x + n, LookupStrip(lineP, numSamples, t, nearest));
+        x += n;
+        t += dt * n;
+    }
+}
+
+struct WriteRefcon {
+    PF_InData *in_data;
+    const StripLayout *strip;
+    const void *stripP;  // Samples of all lines in the output depth
+    PF_EffectWorld *worldP;
+    PF_Point origin;  // Of the world in layer pixels
+    PF_PixelFormat format;
+    bool nearest;
+
+    // Whether every row is the same as the first one
+    bool rowsIdentical;
+};
+
+template <typename PixelType>
+static void WriteStripRow(const WriteRefcon *refcon, A_long y) {
+    const StripLayout *strip = refcon->strip;
+    const PixelType *stripP = static_cast<const PixelType *>(refcon->stripP);
+    PF_EffectWorld *worldP = refcon->worldP;
+
+    PixelType *dstP = reinterpret_cast<PixelType *>((char *)worldP->data +
+                                                    y * worldP->rowbytes);
+
+    if (refcon->rowsIdentical && y > 0) {
+        std::memcpy(dstP, worldP->data, worldP->width * sizeof(PixelType));
+        return;
+    }
+
+    float py = refcon->origin.v + y + 0.5f;
+
+    // Rays of the fan are neither parallel nor evenly crossed by the row, so
+    // each pixel is located on its own
+    if (strip->mode == LAYOUT_FAN) {
+        for (A_long x = 0; x < worldP->width; x++) {
+            float l;
+            const StripLine *line =
+                LocateOnStrip(strip, refcon->origin.h + x + 0.5f, py, &l);
+            StripPosition t = ToStripPosition((l - line->start) / strip->step);
+
+            dstP[x] = LookupStrip(stripP + line->firstSample, line->numSamples, t,
+                                  refcon->nearest);
+        }
+        return;
+    }
+
+    // Otherwise the row crosses the lines in runs, along each of which the
+    // position steps evenly
+    double dt = strip->dirX / strip->step;
+
+    // A line running vertically makes each run a single color
+    if (std::abs(dt) * worldP->width < 1e-3f) {
+        dt = 0;
+    }
+
+    A_long x = 0;
+
+    while (x < worldP->width) {
+        float l;
+        const StripLine *line =
+            LocateOnStrip(strip, refcon->origin.h + x + 0.5f, py, &l);
+
+        // Parallel lines are crossed where the index of the nearest one
+        // changes. It is linear along the row, so the crossing is solved for,
+        // then settled against LocateOnStrip itself. Past the outermost
+        // lines, the index stays clamped to them.
+        A_long end = worldP->width;
+        A_long k = (A_long)(line - strip->lines);
+        float du = strip->spacing > 0 ? -strip->dirY / strip->spacing : 0;
+
+        if (strip->mode == LAYOUT_PARALLEL && du != 0 &&
+            (du > 0 ? k < strip->numLines - 1 : k > 0)) {
+            float m = -(refcon->origin.h + x + 0.5f - strip->centerX) * strip->dirY +
+                      (py - strip->centerY) * strip->dirX;
+            float u = m / strip->spacing + (strip->numLines - 1) / 2.0f + 0.5f;
+            float bound = du > 0 ? k + 1 : k;
+
+            end = (A_long)std::min(std::ceil(x + (double)(bound - u) / du),
+                                   (double)worldP->width);
+            end = std::max(end, x + 1);
+
+            auto onLine = [&](A_long px) {
+                float pl;
+                return LocateOnStrip(strip, refcon->origin.h + px + 0.5f, py, &pl) == line;
+            };
+            while (end < worldP->width && onLine(end)) {
+                end++;
+            }
+            while (end - 1 > x && !onLine(end - 1)) {
+                end--;
+            }
+        }
+
+        WriteLineSpan(dstP + x, end - x, stripP + line->firstSample, line->numSamples,
+                      ToStripPosition((l - line->start) / strip->step),
+                      ToStripPosition(dt), refcon->nearest);
+        x = end;
+    }
+}
+
+static void WriteStripRowOfFormat(const WriteRefcon *refcon, A_long y) {
+    switch (refcon->format) {
+        case PF_PixelFormat_ARGB32:
+            WriteStripRow<PF_Pixel8>(refcon, y);
+            break;
+        case PF_PixelFormat_ARGB64:
+            WriteStripRow<PF_Pixel16>(refcon, y);
+            break;
+        case PF_PixelFormat_ARGB128:
+            WriteStripRow<PF_PixelFloat>(refcon, y);
+            break;
+    }
+}
+
+// Row 0 is written up front, as the other rows may copy it
+static PF_Err WriteStripBand(void *refconPV, A_long thread_indexL, A_long i,
+                             A_long iterationsL) {
+    WriteRefcon *refcon = reinterpret_cast<WriteRefcon *>(refconPV);
+
+    A_long yStart = std::max(i * STRIP_BAND_ROWS, (A_long)1);
+    A_long yEnd = std::min((i + 1) * STRIP_BAND_ROWS, refcon->worldP->height);
+
+    for (A_long y = yStart; y < yEnd; y++) {
+        WriteStripRowOfFormat(refcon, y);
+    }
+
+    return PF_ABORT(refcon->in_data);
+}
+
 static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
                           PF_SmartRenderExtra *extra) {
     PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
 
     AEGP_SuiteHandler suites(in_data->pica_basicP);
 
-    PF_EffectWorld *input_worldP = nullptr, *output_worldP = nullptr;
+    PF_EffectWorld *output_worldP = nullptr;
     PF_WorldSuite2 *wsP = nullptr;
 
     // Retrieve paramInfo
-    auto handleSuite = suites.HandleSuite1();
-
     ParamInfo *paramInfo =
-        reinterpret_cast<ParamInfo *>(handleSuite->host_lock_handle(
-            reinterpret_cast<PF_Handle>(extra->input->pre_render_data)));
+        reinterpret_cast<ParamInfo *>(extra->input->pre_render_data);
+
+    const StripLayout *strip = &paramInfo->strip;
 
-    // Checkout layer pixels
-    ERR((extra->cb->checkout_layer_pixels(in_data->effect_ref, PARAM_INPUT,
-                                          &input_worldP)));
     ERR(extra->cb->checkout_output(in_data->effect_ref, &output_worldP));
 
     // Setup wsP
@@ -189,85 +756,98 @@ static PF_Err SmartRender(PF_InData *in_data, PF_OutData *out_data,
                           kPFWorldSuiteVersion2, "Couldn't load suite.",
                           (void **)&wsP));
 
-    // Get pixel format
+    // Get pixel format. The output has the same one as the input.
     PF_PixelFormat format = PF_PixelFormat_INVALID;
-    ERR(wsP->PF_GetPixelFormat(input_worldP, &format));
+    ERR(wsP->PF_GetPixelFormat(output_worldP, &format));
 
-    auto *globalData = reinterpret_cast<GlobalData *>(
-        handleSuite->host_lock_handle(in_data->global_data));
+    if (!err && strip->numSamples > 0) {
+        FX_LOG_TIME_START(stripTime);
 
-    // OpenGL
-    if (!err) {
-        globalData->globalContext.bind();
+        // Input -> strip, piece by piece, in the output depth, so that the
+        // rows are filled and interpolated in it. Pieces with nothing checked
+        // out stay transparent.
+        std::vector<PF_Pixel8> samples8;
+        std::vector<PF_Pixel16> samples16;
+        std::vector<PF_PixelFloat> samplesFloat;
+        const void *stripP = nullptr;
 
-        GLenum pixelType;
         switch (format) {
             case PF_PixelFormat_ARGB32:
-                pixelType = GL_UNSIGNED_BYTE;
+                samples8.resize(strip->numSamples, PF_Pixel8{0, 0, 0, 0});
+                stripP = samples8.data();
                 break;
             case PF_PixelFormat_ARGB64:
-                pixelType = GL_UNSIGNED_SHORT;
+                samples16.resize(strip->numSamples, PF_Pixel16{0, 0, 0, 0});
+                stripP = samples16.data();
                 break;
             case PF_PixelFormat_ARGB128:
-                pixelType = GL_FLOAT;
+                samplesFloat.resize(strip->numSamples, PF_PixelFloat{0, 0, 0, 0});
+                stripP = samplesFloat.data();
                 break;
         }
 
-        GLsizei width = input_worldP->width;
-        GLsizei height = input_worldP->height;
-        size_t pixelBytes = AEOGLInterop::getPixelBytes(pixelType);
-
-        // Setup render context
-        globalData->fbo.allocate(width, height, GL_RGBA, pixelType);
-        globalData->inputTexture.allocate(width, height, GL_RGBA, pixelType);
-
-        // Allocate pixels buffer
-        PF_Handle pixelsBufferH =
-            handleSuite->host_new_handle(width * height * pixelBytes);
-        void *pixelsBufferP = reinterpret_cast<char *>(
-            handleSuite->host_lock_handle(pixelsBufferH));
-
-        // Upload buffer to OpenGL texture
-        AEOGLInterop::uploadTexture(&globalData->inputTexture,
-                                    input_worldP, pixelsBufferP, pixelType);
-
-        // Bind
-        globalData->program.bind();
-        globalData->fbo.bind();
-
-        // Set uniforms
-        globalData->program.setTexture("tex0", &globalData->inputTexture, 0);
-
-        float multiplier16bit = AEOGLInterop::getMultiplier16bit(pixelType);
-        globalData->program.setFloat("multiplier16bit", multiplier16bit);
-        globalData->program.setFloat("angle", paramInfo->angle);
-        globalData->program.setVec2("center", paramInfo->center.x,
-                                    paramInfo->center.y);
-        globalData->program.setFloat("aspectY",
-                                     (float)height / (float)width);
-
-        // Render
-        globalData->quad.render();
-
-        // Read pixels
-        globalData->fbo.readToPixels(pixelsBufferP);
-        ERR(AEOGLInterop::downloadTexture(pixelsBufferP, output_worldP, pixelType));
+        std::vector<StripTap> taps;
+        GetFilterTaps(strip, &taps);
+
+        for (A_long k = 0; !err && k < strip->numPieces; k++) {
+            const StripPiece *piece = &strip->pieces[k];
+            PF_EffectWorld *input_worldP = nullptr;
+
+            ERR(extra->cb->checkout_layer_pixels(in_data->effect_ref, k,
+                                                 &input_worldP));
+
+            if (err || !input_worldP || AEUtils::isEmptyRect(&piece->inputRect)) {
+                continue;
+            }
+
+            switch (format) {
+                case PF_PixelFormat_ARGB32:
+                    SampleStrip(input_worldP, strip, piece, taps, paramInfo->nearest,
+                                samples8.data());
+                    break;
+                case PF_PixelFormat_ARGB64:
+                    SampleStrip(input_worldP, strip, piece, taps, paramInfo->nearest,
+                                samples16.data());
+                    break;
+                case PF_PixelFormat_ARGB128:
+                    SampleStrip(input_worldP, strip, piece, taps, paramInfo->nearest,
+                                samplesFloat.data());
+                    break;
+            }
+
+            ERR2(extra->cb->checkin_layer_pixels(in_data->effect_ref, k));
+        }
 
-        // Unbind
-        globalData->fbo.unbind();
-//        globalData->program.unbind();
+        // Strip -> AE pixels
+        WriteRefcon refcon;
+        refcon.in_data = in_data;
+        refcon.strip = strip;
+        refcon.stripP = stripP;
+        refcon.worldP = output_worldP;
+        refcon.origin.h = paramInfo->outputRect.left;
+        refcon.origin.v = paramInfo->outputRect.top;
+        refcon.format = format;
+        refcon.nearest = paramInfo->nearest;
+
+        // A single line running horizontally makes every row the same, so
+        // the first row is written alone before the others copy it
+        refcon.rowsIdentical = false;
+        if (output_worldP->height > 0) {
+            WriteStripRowOfFormat(&refcon, 0);
+        }
+        refcon.rowsIdentical =
+            strip->mode == LAYOUT_SINGLE &&
+            std::abs(strip->dirY / strip->step) * output_worldP->height < 1e-3f;
 
-        // downloadTexture
-        ERR(AEOGLInterop::downloadTexture(pixelsBufferP, output_worldP, pixelType));
+        A_long bands = (output_worldP->height + STRIP_BAND_ROWS - 1) / STRIP_BAND_ROWS;
+        ERR(suites.Iterate8Suite1()->iterate_generic(bands, &refcon, WriteStripBand));
 
-        handleSuite->host_unlock_handle(pixelsBufferH);
-        handleSuite->host_dispose_handle(pixelsBufferH);
+        FX_LOG_TIME_END(stripTime, "Strip");
     }
 
     // Check in
     ERR2(AEFX_ReleaseSuite(in_data, out_data, kPFWorldSuite,
                            kPFWorldSuiteVersion2, "Couldn't release suite."));
-    ERR2(extra->cb->checkin_layer_pixels(in_data->effect_ref, PARAM_INPUT));
 
     return err;
 }
@@ -304,10 +884,6 @@ PF_Err EffectMain(PF_Cmd cmd, PF_InData *in_data, PF_OutData *out_data,
                 err = ParamsSetup(in_data, out_data, params, output);
                 break;
 
-            case PF_Cmd_GLOBAL_SETDOWN:
-                err = GlobalSetdown(in_data, out_data, params, output);
-                break;
-
             case PF_Cmd_SMART_PRE_RENDER:
                 err = PreRender(in_data, out_data,
                                 reinterpret_cast<PF_PreRenderExtra *>(extra));
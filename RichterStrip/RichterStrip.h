@@ -30,7 +30,10 @@ typedef unsigned short PixelType;
 #include "AEFX_ChannelDepthTpl.h"
 #include "AEGP_SuiteHandler.h"
 
-#include "OGL.h"
+#include "PixelSampler.hpp"
+#include "PreRenderPool.hpp"
+
+#include <vector>
 
 /* Other useful constants */
 #define PF_MAX_CHAN32 1.0f
@@ -45,22 +48,104 @@ typedef unsigned short PixelType;
 
 /* Parameter defaults */
 
+// Spacing of strip samples in pixels for draft quality renders
+#define DRAFT_SAMPLE_STRIDE 4.0f
+
+// Number of output rows written per job
+#define STRIP_BAND_ROWS 32
+
+// Diagonal lines are checked out as a chain of smaller rects rather than one
+// rect spanning the whole diagonal. Each piece spans at least
+// STRIP_MIN_PIECE_SPAN pixels across the minor axis of the line.
+#define STRIP_MAX_PIECES 8
+#define STRIP_MIN_PIECE_SPAN 64
+
+// Most lines sampled in the Parallel and Fan layouts
+#define STRIP_MAX_LINES 64
+
+// Fractional bits of the positions rows step along the lines with, enough
+// for the step not to drift by a sample across the widest rows
+#define STRIP_POSITION_BITS 32
+
 enum { PARAM_INPUT = 0,
        PARAM_CENTER,
        PARAM_ANGLE,
+       PARAM_SAMPLE_WIDTH,
+       PARAM_FILTER,
+       PARAM_LAYOUT,
+       PARAM_COUNT,
+       PARAM_SPACING,
        PARAM_NUM_PARAMS };
 
-struct GlobalData {
-    OGL::GlobalContext globalContext;
-    OGL::Texture inputTexture;
-    OGL::Shader program;
-    OGL::Fbo fbo;
-    OGL::QuadVao quad;
+enum { FILTER_BOX = 1,
+       FILTER_GAUSSIAN };
+
+enum { LAYOUT_SINGLE = 1,
+       LAYOUT_PARALLEL,
+       LAYOUT_FAN };
+
+// A tap of the filter across the line, as its offset along the normal in
+// layer pixels and its weight, also in fixed point for 8/16bpc layers
+struct StripTap {
+    float offset, weight;
+    int fixedWeight;
+};
+
+// A line of the strip, in layer pixels with pixel centers at half-integers
+struct StripLine {
+    float centerX, centerY;
+    float dirX, dirY;
+
+    // Position along the line of its first sample, and where its samples
+    // begin among those of all lines
+    float start;
+    A_long firstSample, numSamples;
+};
+
+// A run of strip samples, and the input rect checked out to take them from
+struct StripPiece {
+    A_long firstSample, endSample;
+    PF_LRect inputRect;  // In layer pixels, as returned by checkout_layer
+};
+
+// Every output pixel takes the color at its projection onto a line, so the
+// output is made of 1D functions of the position along the lines. The strip
+// holds them, sampled once per frame.
+//
+// Single lays out one line through the center. Parallel lays out lines
+// along the normal at the spacing, and each pixel takes the nearest one. Fan
+// lays out rays from the center at even angles, and each pixel takes the
+// nearest ray at its distance from the center.
+//
+// The layout is decided in PreRender, since it tells which pixels of the
+// input are read at all.
+struct StripLayout {
+    A_long mode;
+
+    // The line through the center the others are laid out from
+    float centerX, centerY;
+    float dirX, dirY;
+    float spacing;  // Between parallel lines, in layer pixels
+
+    A_long numLines;
+    StripLine lines[STRIP_MAX_LINES];
+
+    // Spacing of samples along the lines, and their number over all lines
+    float step;
+    A_long numSamples;
+
+    // Extent of the filter across the line, in layer pixels
+    float width;
+    A_long filter;
+
+    A_long numPieces;
+    StripPiece pieces[STRIP_MAX_PIECES];
 };
 
 struct ParamInfo {
-    A_FloatPoint center;
-    A_FpLong angle;
+    StripLayout strip;
+    PF_LRect outputRect;  // In layer pixels
+    bool nearest;
 };
 
 extern "C" {